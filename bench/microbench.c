@@ -0,0 +1,623 @@
+#define _POSIX_C_SOURCE 200809L
+#include <stdbool.h>
+#include <stdio.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "alloc.h"
+#include "fatal_error.h"
+#include "disc_impl.h"
+#include "encoding_impl.h"
+#include "stub.h"
+#include "wbx_impl.h"
+
+// microbenchmarks for the primitives under the emulation loop, none of which need game assets
+// the disc image is synthesized on every run, the wbx benchmarks are skipped if the core isn't next to the binary
+
+// mednadisc imports
+void mednadisc_EncodeMode1Sector(uint32_t aba, uint8_t* sector2352);
+uint32_t mednadisc_EDC(const uint8_t* data, int32_t len);
+int32_t mednadisc_EDCImpl(int32_t impl, const uint8_t* data, int32_t len, uint32_t* edc);
+int32_t mednadisc_PQParityImpl(int32_t impl, uint8_t* sector2352);
+int32_t mednadisc_CheckAndCorrectSector(uint8_t* sector2352, bool xa);
+void mednadisc_SubPWInterleave(const uint8_t* in96, uint8_t* out96);
+void mednadisc_SubPWDeinterleave(const uint8_t* in96, uint8_t* out96);
+
+#define MICROBENCH_CUE_FILE "microbench.cue"
+#define MICROBENCH_BIN_FILE "microbench.bin"
+#define MICROBENCH_ISO_CUE_FILE "microbench_iso.cue" // the same data track, stored cooked
+#define MICROBENCH_ISO_FILE "microbench.iso"
+#define MICROBENCH_HCD_FILE "microbench.hcd" // the raw image, hunk compressed
+#define MICROBENCH_VIDEO_FILE "microbench.avi"
+#define MICROBENCH_WBX_FILE "gpgx.wbx"
+#define MICROBENCH_DATA_SECTORS 8192 // 19 MiB of mode 1
+#define MICROBENCH_AUDIO_SECTORS 1024
+#define MICROBENCH_RANDOM_LBAS 4096 // must be a power of 2
+#define MICROBENCH_MIN_NS 250000000ULL // iterations double until a run takes at least this long
+
+typedef void (*microbench_fn_t)(void* userdata, uint64_t iterations);
+
+// results are folded into this, so the compiler can't drop the work
+static volatile uint64_t microbench_sink;
+
+static uint64_t microbench_now(void) {
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+}
+
+static uint64_t microbench_xorshift(uint64_t* state) {
+	*state ^= *state << 13;
+	*state ^= *state >> 7;
+	*state ^= *state << 17;
+	return *state;
+}
+
+static void microbench_fill(uint8_t* buffer, uint32_t length, uint64_t seed) {
+	uint64_t state = seed * 0x9E3779B97F4A7C15ULL + 1;
+	for (uint32_t i = 0; i < length; i++) {
+		buffer[i] = microbench_xorshift(&state);
+	}
+}
+
+static void microbench_run(const char* name, microbench_fn_t fn, void* userdata, uint64_t bytes_per_op) {
+	uint64_t iterations = 1;
+	uint64_t elapsed;
+	while (true) {
+		uint64_t start = microbench_now();
+		fn(userdata, iterations);
+		elapsed = microbench_now() - start;
+		if (elapsed >= MICROBENCH_MIN_NS) {
+			break;
+		}
+		iterations *= 2;
+	}
+
+	double ns_per_op = (double)elapsed / iterations;
+	printf("%-32s %12lu %12.1f", name, iterations, ns_per_op);
+	if (bytes_per_op) {
+		printf(" %10.1f", bytes_per_op * 1000.0 / ns_per_op);
+	}
+	printf("\n");
+	fflush(stdout);
+}
+
+static void microbench_write_disc(void) {
+	FILE* bin = fopen(MICROBENCH_BIN_FILE, "wb");
+	if (!bin) {
+		FATAL_ERROR("Could not open %s", MICROBENCH_BIN_FILE);
+	}
+
+	FILE* iso = fopen(MICROBENCH_ISO_FILE, "wb");
+	if (!iso) {
+		FATAL_ERROR("Could not open %s", MICROBENCH_ISO_FILE);
+	}
+
+	uint8_t sector[2352];
+	for (uint32_t lba = 0; lba < MICROBENCH_DATA_SECTORS; lba++) {
+		memset(sector, 0, sizeof(sector));
+		microbench_fill(&sector[16], 2048, lba);
+		mednadisc_EncodeMode1Sector(lba + 150, sector);
+		if (fwrite(sector, sizeof(sector), 1, bin) != 1) {
+			FATAL_ERROR("Failed to write %s", MICROBENCH_BIN_FILE);
+		}
+		if (fwrite(&sector[16], 2048, 1, iso) != 1) {
+			FATAL_ERROR("Failed to write %s", MICROBENCH_ISO_FILE);
+		}
+	}
+
+	if (fclose(iso)) {
+		FATAL_ERROR("Failed to write %s", MICROBENCH_ISO_FILE);
+	}
+
+	for (uint32_t lba = MICROBENCH_DATA_SECTORS; lba < MICROBENCH_DATA_SECTORS + MICROBENCH_AUDIO_SECTORS; lba++) {
+		microbench_fill(sector, sizeof(sector), lba);
+		if (fwrite(sector, sizeof(sector), 1, bin) != 1) {
+			FATAL_ERROR("Failed to write %s", MICROBENCH_BIN_FILE);
+		}
+	}
+
+	if (fclose(bin)) {
+		FATAL_ERROR("Failed to write %s", MICROBENCH_BIN_FILE);
+	}
+
+	FILE* cue = fopen(MICROBENCH_CUE_FILE, "w");
+	if (!cue) {
+		FATAL_ERROR("Could not open %s", MICROBENCH_CUE_FILE);
+	}
+
+	fprintf(cue, "FILE \"%s\" BINARY\n", MICROBENCH_BIN_FILE);
+	fprintf(cue, "  TRACK 01 MODE1/2352\n");
+	fprintf(cue, "    INDEX 01 00:00:00\n");
+	fprintf(cue, "  TRACK 02 AUDIO\n");
+	fprintf(cue, "    INDEX 01 %02d:%02d:%02d\n", MICROBENCH_DATA_SECTORS / 75 / 60, MICROBENCH_DATA_SECTORS / 75 % 60, MICROBENCH_DATA_SECTORS % 75);
+	if (fclose(cue)) {
+		FATAL_ERROR("Failed to write %s", MICROBENCH_CUE_FILE);
+	}
+
+	cue = fopen(MICROBENCH_ISO_CUE_FILE, "w");
+	if (!cue) {
+		FATAL_ERROR("Could not open %s", MICROBENCH_ISO_CUE_FILE);
+	}
+
+	fprintf(cue, "FILE \"%s\" BINARY\n", MICROBENCH_ISO_FILE);
+	fprintf(cue, "  TRACK 01 MODE1/2048\n");
+	fprintf(cue, "    INDEX 01 00:00:00\n");
+	if (fclose(cue)) {
+		FATAL_ERROR("Failed to write %s", MICROBENCH_ISO_CUE_FILE);
+	}
+}
+
+typedef struct {
+	disc_impl_t* disc;
+	uint32_t* random_lbas;
+	uint8_t buffer[2448];
+} microbench_disc_t;
+
+static void microbench_disc_2048_seq(void* userdata, uint64_t iterations) {
+	microbench_disc_t* ctx = userdata;
+	for (uint64_t i = 0; i < iterations; i++) {
+		disc_impl_read_lba_2048(ctx->disc, i % MICROBENCH_DATA_SECTORS, ctx->buffer);
+	}
+	microbench_sink += ctx->buffer[0];
+}
+
+static void microbench_disc_2048_random(void* userdata, uint64_t iterations) {
+	microbench_disc_t* ctx = userdata;
+	for (uint64_t i = 0; i < iterations; i++) {
+		disc_impl_read_lba_2048(ctx->disc, ctx->random_lbas[i & (MICROBENCH_RANDOM_LBAS - 1)], ctx->buffer);
+	}
+	microbench_sink += ctx->buffer[0];
+}
+
+static void microbench_disc_2352_seq(void* userdata, uint64_t iterations) {
+	microbench_disc_t* ctx = userdata;
+	for (uint64_t i = 0; i < iterations; i++) {
+		disc_impl_read_lba_2352(ctx->disc, i % MICROBENCH_DATA_SECTORS, ctx->buffer);
+	}
+	microbench_sink += ctx->buffer[0];
+}
+
+static void microbench_disc_2352_random(void* userdata, uint64_t iterations) {
+	microbench_disc_t* ctx = userdata;
+	for (uint64_t i = 0; i < iterations; i++) {
+		disc_impl_read_lba_2352(ctx->disc, ctx->random_lbas[i & (MICROBENCH_RANDOM_LBAS - 1)], ctx->buffer);
+	}
+	microbench_sink += ctx->buffer[0];
+}
+
+static void microbench_disc_2448_seq(void* userdata, uint64_t iterations) {
+	microbench_disc_t* ctx = userdata;
+	for (uint64_t i = 0; i < iterations; i++) {
+		disc_impl_read_lba_2448(ctx->disc, i % MICROBENCH_DATA_SECTORS, ctx->buffer, true);
+	}
+	microbench_sink += ctx->buffer[0];
+}
+
+static void microbench_disc_2448_random(void* userdata, uint64_t iterations) {
+	microbench_disc_t* ctx = userdata;
+	for (uint64_t i = 0; i < iterations; i++) {
+		disc_impl_read_lba_2448(ctx->disc, ctx->random_lbas[i & (MICROBENCH_RANDOM_LBAS - 1)], ctx->buffer, true);
+	}
+	microbench_sink += ctx->buffer[0];
+}
+
+static void microbench_disc_config(const char* filename, const char* suffix, const disc_impl_options_t* options) {
+	microbench_disc_t ctx;
+	ctx.disc = disc_impl_create(filename, options);
+	ctx.random_lbas = salloc(sizeof(uint32_t) * MICROBENCH_RANDOM_LBAS);
+	uint64_t state = 1;
+	for (uint32_t i = 0; i < MICROBENCH_RANDOM_LBAS; i++) {
+		ctx.random_lbas[i] = microbench_xorshift(&state) % MICROBENCH_DATA_SECTORS;
+	}
+
+	// make sure the image reads back before timing anything
+	uint8_t expected[2048];
+	for (uint32_t lba = 0; lba < MICROBENCH_DATA_SECTORS; lba += MICROBENCH_DATA_SECTORS / 16) {
+		microbench_fill(expected, sizeof(expected), lba);
+		disc_impl_read_lba_2048(ctx.disc, lba, ctx.buffer);
+		if (memcmp(ctx.buffer, expected, sizeof(expected))) {
+			FATAL_ERROR("Synthetic disc read back wrong at LBA %d", lba);
+		}
+	}
+
+	static const struct {
+		const char* name;
+		microbench_fn_t fn;
+		uint32_t bytes;
+	} reads[] = {
+		{ "disc_read_2048_seq", microbench_disc_2048_seq, 2048 },
+		{ "disc_read_2048_random", microbench_disc_2048_random, 2048 },
+		{ "disc_read_2352_seq", microbench_disc_2352_seq, 2352 },
+		{ "disc_read_2352_random", microbench_disc_2352_random, 2352 },
+		{ "disc_read_2448_seq", microbench_disc_2448_seq, 2448 },
+		{ "disc_read_2448_random", microbench_disc_2448_random, 2448 },
+	};
+
+	for (uint32_t i = 0; i < sizeof(reads) / sizeof(reads[0]); i++) {
+		char name[64];
+		snprintf(name, sizeof(name), "%s%s", reads[i].name, suffix);
+		microbench_run(name, reads[i].fn, &ctx, reads[i].bytes);
+	}
+
+	free(ctx.random_lbas);
+	disc_impl_destroy(ctx.disc);
+}
+
+static void microbench_disc(void) {
+	microbench_write_disc();
+
+	disc_impl_options_t options;
+	options.cache_sectors = 0;
+	options.max_readahead = 0;
+	options.prefetch_sectors = 0;
+	options.memcache = false;
+	options.preload = DISC_IMPL_PRELOAD_NONE;
+	microbench_disc_config(MICROBENCH_CUE_FILE, "", &options);
+	options.cache_sectors = DISC_IMPL_DEFAULT_CACHE_SECTORS;
+	options.max_readahead = DISC_IMPL_DEFAULT_MAX_READAHEAD;
+	microbench_disc_config(MICROBENCH_CUE_FILE, "_cached", &options);
+	// the defaults leave the worker off for a mapped image, so ask for it
+	options.prefetch_sectors = DISC_IMPL_DEFAULT_PREFETCH_SECTORS;
+	options.preload = DISC_IMPL_DEFAULT_PRELOAD;
+	microbench_disc_config(MICROBENCH_CUE_FILE, "_prefetch", &options);
+	microbench_disc_config(MICROBENCH_ISO_CUE_FILE, "_iso", NULL);
+
+	// uncached, so these are the decompression costs, to compare against the first config
+	// then with the defaults, where the worker decompresses hunks ahead of the reads
+	options.cache_sectors = 0;
+	options.max_readahead = 0;
+	options.prefetch_sectors = 0;
+	options.preload = DISC_IMPL_PRELOAD_NONE;
+	static const struct {
+		disc_impl_codec_t codec;
+		const char* suffix;
+	} codecs[] = {
+		{ DISC_IMPL_CODEC_DEFLATE, "_hcd_deflate" },
+		{ DISC_IMPL_CODEC_LZMA, "_hcd_lzma" },
+	};
+	for (uint32_t i = 0; i < sizeof(codecs) / sizeof(codecs[0]); i++) {
+		if (!disc_impl_convert(MICROBENCH_CUE_FILE, MICROBENCH_HCD_FILE, codecs[i].codec)) {
+			FATAL_ERROR("Failed to convert %s to %s", MICROBENCH_CUE_FILE, MICROBENCH_HCD_FILE);
+		}
+
+		microbench_disc_config(MICROBENCH_HCD_FILE, codecs[i].suffix, &options);
+		char suffix[64];
+		snprintf(suffix, sizeof(suffix), "%s_prefetch", codecs[i].suffix);
+		microbench_disc_config(MICROBENCH_HCD_FILE, suffix, NULL);
+	}
+
+	unlink(MICROBENCH_CUE_FILE);
+	unlink(MICROBENCH_BIN_FILE);
+	unlink(MICROBENCH_ISO_CUE_FILE);
+	unlink(MICROBENCH_ISO_FILE);
+	unlink(MICROBENCH_HCD_FILE);
+}
+
+typedef struct {
+	uint8_t sector[2352];
+	uint8_t scratch[2352];
+	uint8_t subpw[96];
+} microbench_sector_t;
+
+static void microbench_encode_mode1(void* userdata, uint64_t iterations) {
+	microbench_sector_t* ctx = userdata;
+	for (uint64_t i = 0; i < iterations; i++) {
+		mednadisc_EncodeMode1Sector(i + 150, ctx->scratch);
+	}
+	microbench_sink += ctx->scratch[2351];
+}
+
+static void microbench_edc(void* userdata, uint64_t iterations) {
+	microbench_sector_t* ctx = userdata;
+	uint32_t edc = 0;
+	for (uint64_t i = 0; i < iterations; i++) {
+		ctx->sector[0] = i;
+		edc ^= mednadisc_EDC(ctx->sector, 2064);
+	}
+	microbench_sink += edc;
+}
+
+// same order as the EDC_IMPL_* enum in mednadisc
+static const char* const microbench_edc_impls[] = { "bytewise", "slice8", "clmul" };
+
+typedef struct {
+	int32_t impl;
+	int32_t len;
+	uint8_t data[2352];
+} microbench_edc_impl_t;
+
+static void microbench_edc_impl(void* userdata, uint64_t iterations) {
+	microbench_edc_impl_t* ctx = userdata;
+	uint32_t edc = 0;
+	for (uint64_t i = 0; i < iterations; i++) {
+		uint32_t crc;
+		ctx->data[0] = i;
+		mednadisc_EDCImpl(ctx->impl, ctx->data, ctx->len, &crc);
+		edc ^= crc;
+	}
+	microbench_sink += edc;
+}
+
+// every implementation has to match the bytewise one for every length and alignment, or the timings are meaningless
+static void microbench_edc_verify(microbench_edc_impl_t* ctx) {
+	for (int32_t impl = 1; impl < (int32_t)(sizeof(microbench_edc_impls) / sizeof(microbench_edc_impls[0])); impl++) {
+		uint32_t crc;
+		if (!mednadisc_EDCImpl(impl, ctx->data, 0, &crc)) {
+			continue;
+		}
+
+		for (int32_t offset = 0; offset < 16; offset++) {
+			for (int32_t len = 0; len <= (int32_t)sizeof(ctx->data) - offset; len++) {
+				uint32_t expected;
+				mednadisc_EDCImpl(0, &ctx->data[offset], len, &expected);
+				mednadisc_EDCImpl(impl, &ctx->data[offset], len, &crc);
+				if (crc != expected) {
+					FATAL_ERROR("EDC implementation %s is wrong for %d bytes at offset %d", microbench_edc_impls[impl], len, offset);
+				}
+			}
+		}
+	}
+}
+
+static void microbench_edc_impls_run(void) {
+	microbench_edc_impl_t* ctx = zalloc(sizeof(microbench_edc_impl_t));
+	microbench_fill(ctx->data, sizeof(ctx->data), 0);
+	microbench_edc_verify(ctx);
+
+	// the mode 1 and mode 2 form 2 EDC spans
+	static const int32_t lens[] = { 2064, 2332 };
+	for (uint32_t i = 0; i < sizeof(lens) / sizeof(lens[0]); i++) {
+		for (int32_t impl = 0; impl < (int32_t)(sizeof(microbench_edc_impls) / sizeof(microbench_edc_impls[0])); impl++) {
+			uint32_t crc;
+			if (!mednadisc_EDCImpl(impl, ctx->data, 0, &crc)) {
+				continue;
+			}
+
+			char name[64];
+			snprintf(name, sizeof(name), "edc_%d_%s", lens[i], microbench_edc_impls[impl]);
+			ctx->impl = impl;
+			ctx->len = lens[i];
+			microbench_run(name, microbench_edc_impl, ctx, lens[i]);
+		}
+	}
+
+	free(ctx);
+}
+
+// same order as the LEC_PARITY_* enum in mednadisc
+static const char* const microbench_pq_impls[] = { "scalar", "ssse3", "avx2" };
+
+typedef struct {
+	int32_t impl;
+	uint8_t sector[2352];
+	uint8_t expected[2352];
+} microbench_pq_impl_t;
+
+static void microbench_pq_impl(void* userdata, uint64_t iterations) {
+	microbench_pq_impl_t* ctx = userdata;
+	for (uint64_t i = 0; i < iterations; i++) {
+		ctx->sector[16] = i;
+		mednadisc_PQParityImpl(ctx->impl, ctx->sector);
+	}
+	microbench_sink += ctx->sector[2351];
+}
+
+// the parity is linear in the 2064 bytes it covers, so matching the scalar code for every value of every byte on its own proves
+// the implementations match for every sector
+static void microbench_pq_verify(microbench_pq_impl_t* ctx) {
+	for (int32_t impl = 1; impl < (int32_t)(sizeof(microbench_pq_impls) / sizeof(microbench_pq_impls[0])); impl++) {
+		memset(ctx->sector, 0, sizeof(ctx->sector));
+		if (!mednadisc_PQParityImpl(impl, ctx->sector)) {
+			continue;
+		}
+
+		for (uint32_t pos = 12; pos < 2076; pos++) {
+			for (uint32_t value = 1; value < 256; value++) {
+				memset(ctx->sector, 0, sizeof(ctx->sector));
+				ctx->sector[pos] = value;
+				memcpy(ctx->expected, ctx->sector, sizeof(ctx->expected));
+				mednadisc_PQParityImpl(0, ctx->expected);
+				mednadisc_PQParityImpl(impl, ctx->sector);
+				if (memcmp(ctx->sector, ctx->expected, sizeof(ctx->expected))) {
+					FATAL_ERROR("P/Q parity implementation %s is wrong for byte %u = %u", microbench_pq_impls[impl], pos, value);
+				}
+			}
+		}
+	}
+}
+
+static void microbench_pq_impls_run(void) {
+	microbench_pq_impl_t* ctx = zalloc(sizeof(microbench_pq_impl_t));
+	microbench_pq_verify(ctx);
+
+	microbench_fill(ctx->sector, sizeof(ctx->sector), 0);
+	for (int32_t impl = 0; impl < (int32_t)(sizeof(microbench_pq_impls) / sizeof(microbench_pq_impls[0])); impl++) {
+		if (!mednadisc_PQParityImpl(impl, ctx->sector)) {
+			continue;
+		}
+
+		char name[64];
+		snprintf(name, sizeof(name), "pq_parity_%s", microbench_pq_impls[impl]);
+		ctx->impl = impl;
+		microbench_run(name, microbench_pq_impl, ctx, 2352);
+	}
+
+	free(ctx);
+}
+
+// a single corrupted byte, so the EDC fails and the P/Q correction has to run
+static void microbench_ecc_correct(void* userdata, uint64_t iterations) {
+	microbench_sector_t* ctx = userdata;
+	uint32_t corrected = 0;
+	for (uint64_t i = 0; i < iterations; i++) {
+		memcpy(ctx->scratch, ctx->sector, sizeof(ctx->scratch));
+		ctx->scratch[16 + i * 7 % 2048] ^= 0x5A;
+		corrected += mednadisc_CheckAndCorrectSector(ctx->scratch, false);
+	}
+	microbench_sink += corrected;
+}
+
+static void microbench_subpw_interleave(void* userdata, uint64_t iterations) {
+	microbench_sector_t* ctx = userdata;
+	for (uint64_t i = 0; i < iterations; i++) {
+		ctx->subpw[0] = i;
+		mednadisc_SubPWInterleave(ctx->subpw, ctx->scratch);
+	}
+	microbench_sink += ctx->scratch[0];
+}
+
+static void microbench_subpw_deinterleave(void* userdata, uint64_t iterations) {
+	microbench_sector_t* ctx = userdata;
+	for (uint64_t i = 0; i < iterations; i++) {
+		ctx->subpw[0] = i;
+		mednadisc_SubPWDeinterleave(ctx->subpw, ctx->scratch);
+	}
+	microbench_sink += ctx->scratch[0];
+}
+
+static void microbench_sector(void) {
+	microbench_sector_t* ctx = zalloc(sizeof(microbench_sector_t));
+	microbench_fill(&ctx->sector[16], 2048, 0);
+	mednadisc_EncodeMode1Sector(150, ctx->sector);
+	memcpy(ctx->scratch, ctx->sector, sizeof(ctx->scratch));
+	microbench_fill(ctx->subpw, sizeof(ctx->subpw), 0);
+
+	ctx->scratch[100] ^= 0x5A;
+	if (!mednadisc_CheckAndCorrectSector(ctx->scratch, false) || memcmp(ctx->scratch, ctx->sector, sizeof(ctx->sector))) {
+		FATAL_ERROR("Sector correction failed on a single byte error");
+	}
+
+	uint8_t interleaved[96];
+	mednadisc_SubPWInterleave(ctx->subpw, interleaved);
+	mednadisc_SubPWDeinterleave(interleaved, ctx->scratch);
+	if (memcmp(ctx->scratch, ctx->subpw, sizeof(ctx->subpw))) {
+		FATAL_ERROR("Subchannel deinterleaving does not undo interleaving");
+	}
+
+	microbench_run("encode_mode1_sector", microbench_encode_mode1, ctx, 2352);
+	microbench_run("edc", microbench_edc, ctx, 2064);
+	microbench_edc_impls_run();
+	microbench_pq_impls_run();
+	microbench_run("ecc_correct_1_byte", microbench_ecc_correct, ctx, 2352);
+	microbench_run("subpw_interleave", microbench_subpw_interleave, ctx, 96);
+	microbench_run("subpw_deinterleave", microbench_subpw_deinterleave, ctx, 96);
+
+	free(ctx);
+}
+
+typedef struct {
+	wbx_impl_t* wbx;
+	void* state;
+	uintptr_t length;
+} microbench_wbx_t;
+
+static void microbench_wbx_save(void* userdata, uint64_t iterations) {
+	microbench_wbx_t* ctx = userdata;
+	for (uint64_t i = 0; i < iterations; i++) {
+		uintptr_t length;
+		free(wbx_impl_save_state(ctx->wbx, &length));
+	}
+}
+
+static void microbench_wbx_load(void* userdata, uint64_t iterations) {
+	microbench_wbx_t* ctx = userdata;
+	for (uint64_t i = 0; i < iterations; i++) {
+		wbx_impl_load_state(ctx->wbx, ctx->state, ctx->length);
+	}
+}
+
+static void microbench_wbx(void) {
+	if (access(MICROBENCH_WBX_FILE, F_OK)) {
+		printf("%s not found, skipping wbx benchmarks\n", MICROBENCH_WBX_FILE);
+		return;
+	}
+
+	// same layout as the gpgx core, sealed straight away as only the state size matters here
+	microbench_wbx_t ctx;
+	ctx.wbx = wbx_impl_create(MICROBENCH_WBX_FILE, 512, 4 * 1024, 4 * 1024, 34 * 1024, 1 * 1024);
+	wbx_impl_enter(ctx.wbx);
+	wbx_impl_seal(ctx.wbx);
+	ctx.state = wbx_impl_save_state(ctx.wbx, &ctx.length);
+
+	microbench_run("wbx_save_state", microbench_wbx_save, &ctx, ctx.length);
+	microbench_run("wbx_load_state", microbench_wbx_load, &ctx, ctx.length);
+
+	free(ctx.state);
+	wbx_impl_exit(ctx.wbx);
+	wbx_impl_destroy(ctx.wbx);
+}
+
+typedef WBX_CALL uint64_t (*microbench_callback_t)(uint64_t value);
+typedef WBX_CALL uint64_t (*microbench_direct_callback_t)(uint64_t value, void* userdata);
+
+__attribute__((noinline)) WBX_CALL static uint64_t microbench_callback(uint64_t value, void* userdata) {
+	return value + (uintptr_t)userdata;
+}
+
+static void microbench_stub_call(void* userdata, uint64_t iterations) {
+	microbench_callback_t callback = userdata;
+	uint64_t value = 0;
+	for (uint64_t i = 0; i < iterations; i++) {
+		value = callback(value);
+	}
+	microbench_sink += value;
+}
+
+// the same callback without the stub in between, for the baseline
+static void microbench_direct_call(void* userdata, uint64_t iterations) {
+	(void)userdata;
+	microbench_direct_callback_t volatile callback = microbench_callback;
+	uint64_t value = 0;
+	for (uint64_t i = 0; i < iterations; i++) {
+		value = callback(value, (void*)1);
+	}
+	microbench_sink += value;
+}
+
+static void microbench_stub(void) {
+	void* stub = stub_create(microbench_callback, (void*)1, 1);
+	if (((microbench_callback_t)stub)(41) != 42) {
+		FATAL_ERROR("Stub did not pass userdata through");
+	}
+
+	microbench_run("direct_call", microbench_direct_call, NULL, 0);
+	microbench_run("stub_call", microbench_stub_call, stub, 0);
+	stub_destroy(stub);
+}
+
+typedef struct {
+	encoding_impl_t* encoder;
+	uint32_t* video;
+} microbench_encoder_t;
+
+static void microbench_encoder_scale(void* userdata, uint64_t iterations) {
+	microbench_encoder_t* ctx = userdata;
+	for (uint64_t i = 0; i < iterations; i++) {
+		encoding_impl_scale_frame(ctx->encoder, ctx->video, 320 * sizeof(uint32_t));
+	}
+}
+
+static void microbench_encoder(void) {
+	// same settings as the encode mode, nothing is pushed so the file only gets a header
+	microbench_encoder_t ctx;
+	ctx.encoder = encoding_impl_create(MICROBENCH_VIDEO_FILE, "avi", "h264", 1024 * 12, 320, 224, 60, 1, 1);
+	ctx.video = salloc(320 * 224 * sizeof(uint32_t));
+	microbench_fill((uint8_t*)ctx.video, 320 * 224 * sizeof(uint32_t), 0);
+
+	microbench_run("encoder_scale_320x224", microbench_encoder_scale, &ctx, 320 * 224 * sizeof(uint32_t));
+
+	free(ctx.video);
+	encoding_impl_destroy(ctx.encoder);
+	unlink(MICROBENCH_VIDEO_FILE);
+}
+
+int main(void) {
+	printf("%-32s %12s %12s %10s\n", "benchmark", "iterations", "ns/op", "MB/s");
+	microbench_disc();
+	microbench_sector();
+	microbench_wbx();
+	microbench_stub();
+	microbench_encoder();
+	return 0;
+}
@@ -0,0 +1,209 @@
+#ifndef __x86_64__
+#error This file can only be compiled under x86-64
+#endif
+
+#include <stdio.h>
+
+#include "alloc.h"
+#include "fatal_error.h"
+#include "ram_search.h"
+
+typedef struct {
+	ram_search_domain_t domain;
+	uint32_t offset; // within a snapshot
+} ram_search_region_t;
+
+struct ram_search_t {
+	ram_search_region_t* regions;
+	uint32_t num_regions;
+	uint32_t snapshot_size;
+	uint8_t* ring; // ring_len snapshots
+	uint32_t ring_len;
+	uint32_t head; // latest snapshot
+	uint64_t num_snapshots;
+	uint8_t* candidates; // 0xFF per candidate offset, 0 otherwise
+};
+
+ram_search_t* ram_search_create(const ram_search_domain_t* domains, uint32_t num_domains, uint32_t ring_len) {
+	if (!ring_len) {
+		FATAL_ERROR("RAM search needs at least one snapshot");
+	}
+
+	ram_search_t* search = zalloc(sizeof(ram_search_t));
+	search->regions = salloc(sizeof(ram_search_region_t) * num_domains);
+	search->num_regions = num_domains;
+	for (uint32_t i = 0; i < num_domains; i++) {
+		if (domains[i].word_swapped && (domains[i].size & 1)) {
+			FATAL_ERROR("Word swapped domain %s has an odd size", domains[i].name);
+		}
+
+		search->regions[i].domain = domains[i];
+		search->regions[i].offset = search->snapshot_size;
+		search->snapshot_size += domains[i].size;
+	}
+
+	search->ring_len = ring_len;
+	search->ring = salloc((uint64_t)search->snapshot_size * ring_len);
+	search->candidates = salloc(search->snapshot_size);
+	ram_search_reset(search);
+	return search;
+}
+
+void ram_search_destroy(ram_search_t* search) {
+	free(search->regions);
+	free(search->ring);
+	free(search->candidates);
+	free(search);
+}
+
+void ram_search_reset(ram_search_t* search) {
+	memset(search->candidates, 0xFF, search->snapshot_size);
+}
+
+static uint8_t* ram_search_get_snapshot(ram_search_t* search, uint32_t age) {
+	return search->ring + (uint64_t)((search->head + search->ring_len - age) % search->ring_len) * search->snapshot_size;
+}
+
+void ram_search_snapshot(ram_search_t* search) {
+	search->head = (search->head + 1) % search->ring_len;
+	search->num_snapshots++;
+
+	uint8_t* snapshot = ram_search_get_snapshot(search, 0);
+	for (uint32_t i = 0; i < search->num_regions; i++) {
+		ram_search_region_t* region = &search->regions[i];
+		uint8_t* dst = snapshot + region->offset;
+		if (!region->domain.word_swapped) {
+			memcpy(dst, region->domain.data, region->domain.size);
+			continue;
+		}
+
+		const uint8_t* src = region->domain.data;
+		for (uint32_t j = 0; j < region->domain.size; j += 2) {
+			dst[j] = src[j + 1];
+			dst[j + 1] = src[j];
+		}
+	}
+}
+
+// an unsigned compare of multibyte values is a lexicographic compare of their bytes, most significant first
+// done that way, everything stays in 8-bit lanes (one per candidate) and vectorizes without any widening
+static inline __attribute__((always_inline)) uint8_t ram_search_compare(const uint8_t* cur, const uint8_t* old, const uint8_t* value, uintptr_t i, uint32_t width, bool big_endian, ram_search_op_t op) {
+	uint8_t eq = 0xFF, gt = 0, lt = 0;
+	for (uint32_t k = 0; k < width; k++) {
+		uint32_t j = big_endian ? k : width - 1 - k;
+		uint8_t a = cur[i + j];
+		uint8_t b = old ? old[i + j] : value[k];
+		gt |= eq & -(uint8_t)(a > b);
+		lt |= eq & -(uint8_t)(a < b);
+		eq &= -(uint8_t)(a == b);
+	}
+
+	switch (op) {
+		case RAM_SEARCH_EQUAL: return eq;
+		case RAM_SEARCH_NOT_EQUAL: return ~eq;
+		case RAM_SEARCH_GREATER: return gt;
+		case RAM_SEARCH_LESS: return lt;
+		case RAM_SEARCH_GREATER_EQUAL: return ~lt;
+		case RAM_SEARCH_LESS_EQUAL: return ~gt;
+	}
+
+	return 0;
+}
+
+#define RAM_SEARCH_LOOP(WIDTH, BIG_ENDIAN, OP, OLD) \
+	for (uintptr_t i = 0; i < n; i++) { \
+		candidates[i] &= ram_search_compare(cur, OLD, value_bytes, i, WIDTH, BIG_ENDIAN, OP); \
+	}
+
+#define RAM_SEARCH_OPS(WIDTH, BIG_ENDIAN, OLD) \
+	switch (op) { \
+		case RAM_SEARCH_EQUAL: RAM_SEARCH_LOOP(WIDTH, BIG_ENDIAN, RAM_SEARCH_EQUAL, OLD) break; \
+		case RAM_SEARCH_NOT_EQUAL: RAM_SEARCH_LOOP(WIDTH, BIG_ENDIAN, RAM_SEARCH_NOT_EQUAL, OLD) break; \
+		case RAM_SEARCH_GREATER: RAM_SEARCH_LOOP(WIDTH, BIG_ENDIAN, RAM_SEARCH_GREATER, OLD) break; \
+		case RAM_SEARCH_LESS: RAM_SEARCH_LOOP(WIDTH, BIG_ENDIAN, RAM_SEARCH_LESS, OLD) break; \
+		case RAM_SEARCH_GREATER_EQUAL: RAM_SEARCH_LOOP(WIDTH, BIG_ENDIAN, RAM_SEARCH_GREATER_EQUAL, OLD) break; \
+		case RAM_SEARCH_LESS_EQUAL: RAM_SEARCH_LOOP(WIDTH, BIG_ENDIAN, RAM_SEARCH_LESS_EQUAL, OLD) break; \
+	}
+
+// value_bytes holds the value's bytes, most significant first
+#define RAM_SEARCH_FILTER_FUNC(NAME, WIDTH, BIG_ENDIAN) \
+	__attribute__((target_clones("avx2", "default"))) \
+	static void NAME(uint8_t* restrict candidates, const uint8_t* restrict cur, const uint8_t* restrict old, uint32_t n, ram_search_op_t op, const uint8_t* value_bytes) { \
+		if (old) { \
+			RAM_SEARCH_OPS(WIDTH, BIG_ENDIAN, old) \
+		} else { \
+			RAM_SEARCH_OPS(WIDTH, BIG_ENDIAN, NULL) \
+		} \
+	}
+
+RAM_SEARCH_FILTER_FUNC(ram_search_filter8, 1, true)
+RAM_SEARCH_FILTER_FUNC(ram_search_filter16_be, 2, true)
+RAM_SEARCH_FILTER_FUNC(ram_search_filter16_le, 2, false)
+RAM_SEARCH_FILTER_FUNC(ram_search_filter32_be, 4, true)
+RAM_SEARCH_FILTER_FUNC(ram_search_filter32_le, 4, false)
+
+void ram_search_filter(ram_search_t* search, const ram_search_filter_t* filter) {
+	if (filter->age >= search->ring_len || filter->age >= search->num_snapshots) {
+		FATAL_ERROR("RAM search filter needs a snapshot from %d frames ago, which isn't available", filter->age);
+	}
+
+	void (*func)(uint8_t*, const uint8_t*, const uint8_t*, uint32_t, ram_search_op_t, const uint8_t*);
+	switch (filter->width) {
+		case 1: func = ram_search_filter8; break;
+		case 2: func = filter->big_endian ? ram_search_filter16_be : ram_search_filter16_le; break;
+		case 4: func = filter->big_endian ? ram_search_filter32_be : ram_search_filter32_le; break;
+		default: FATAL_ERROR("Invalid RAM search width %d", filter->width);
+	}
+
+	uint8_t value_bytes[4];
+	for (uint32_t k = 0; k < filter->width; k++) {
+		value_bytes[k] = filter->value >> ((filter->width - 1 - k) * 8);
+	}
+
+	const uint8_t* cur = ram_search_get_snapshot(search, 0);
+	const uint8_t* old = filter->age ? ram_search_get_snapshot(search, filter->age) : NULL;
+	for (uint32_t i = 0; i < search->num_regions; i++) {
+		ram_search_region_t* region = &search->regions[i];
+		uint32_t offset = region->offset;
+		uint32_t size = region->domain.size;
+
+		// values can't run off the end of a domain
+		uint32_t n = size >= filter->width ? size - filter->width + 1 : 0;
+		func(search->candidates + offset, cur + offset, old ? old + offset : NULL, n, filter->op, value_bytes);
+		memset(search->candidates + offset + n, 0, size - n);
+	}
+}
+
+uint64_t ram_search_count(ram_search_t* search) {
+	uint64_t count = 0;
+	for (uint32_t i = 0; i < search->snapshot_size; i++) {
+		count += search->candidates[i] & 1;
+	}
+	return count;
+}
+
+void ram_search_print(ram_search_t* search, uint32_t width, bool big_endian, uint32_t max_results) {
+	printf("%ld RAM search candidates\n", ram_search_count(search));
+
+	const uint8_t* cur = ram_search_get_snapshot(search, 0);
+	uint32_t printed = 0;
+	for (uint32_t i = 0; i < search->num_regions && printed < max_results; i++) {
+		ram_search_region_t* region = &search->regions[i];
+		const uint8_t* mem = cur + region->offset;
+		for (uint32_t addr = 0; addr + width <= region->domain.size && printed < max_results; addr++) {
+			if (!search->candidates[region->offset + addr]) {
+				continue;
+			}
+
+			uint32_t value = 0;
+			for (uint32_t j = 0; j < width; j++) {
+				value |= (uint32_t)mem[addr + j] << (big_endian ? (width - 1 - j) * 8 : j * 8);
+			}
+
+			printf("%s 0x%04X = 0x%0*X\n", region->domain.name, addr, width * 2, value);
+			printed++;
+		}
+	}
+
+	fflush(stdout);
+}
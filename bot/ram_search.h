@@ -0,0 +1,49 @@
+#ifndef _RAM_SEARCH_H_
+#define _RAM_SEARCH_H_
+
+#include <stdint.h>
+#include <stdbool.h>
+
+// narrows down which addresses hold a value by filtering candidates against a ring of per-frame memory snapshots
+// every byte offset of every domain starts as a candidate, each filter compares the value starting there
+
+typedef struct {
+	const char* name;
+	const uint8_t* data;
+	uint32_t size;
+	bool word_swapped; // stored as little endian 16-bit words (e.g. 68K RAM), snapshots are unswapped so offsets match guest addresses
+} ram_search_domain_t;
+
+// unsigned comparisons, "changed" and "unchanged" are NOT_EQUAL and EQUAL against an earlier snapshot
+// "never decreased" and "never increased" are GREATER_EQUAL and LESS_EQUAL against the last snapshot
+typedef enum {
+	RAM_SEARCH_EQUAL,
+	RAM_SEARCH_NOT_EQUAL,
+	RAM_SEARCH_GREATER,
+	RAM_SEARCH_LESS,
+	RAM_SEARCH_GREATER_EQUAL,
+	RAM_SEARCH_LESS_EQUAL,
+} ram_search_op_t;
+
+typedef struct {
+	ram_search_op_t op;
+	uint32_t width; // 1, 2 or 4 bytes
+	bool big_endian;
+	uint32_t age; // compare against the snapshot taken this many snapshots ago, or against value if 0
+	uint32_t value;
+} ram_search_filter_t;
+
+struct ram_search_t;
+typedef struct ram_search_t ram_search_t;
+
+// domains are copied, but not the memory they point to, ring_len bounds the age filters can use
+ram_search_t* ram_search_create(const ram_search_domain_t* domains, uint32_t num_domains, uint32_t ring_len);
+void ram_search_destroy(ram_search_t* search);
+void ram_search_reset(ram_search_t* search); // makes every address a candidate again
+
+void ram_search_snapshot(ram_search_t* search); // call once per frame
+void ram_search_filter(ram_search_t* search, const ram_search_filter_t* filter); // filters against the latest snapshot
+uint64_t ram_search_count(ram_search_t* search);
+void ram_search_print(ram_search_t* search, uint32_t width, bool big_endian, uint32_t max_results);
+
+#endif
@@ -0,0 +1,567 @@
+#define _POSIX_C_SOURCE 200809L
+#include <poll.h>
+#include <stdio.h>
+#include <sys/socket.h>
+#include <sys/wait.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "alloc.h"
+#include "fatal_error.h"
+#include "gpgx_impl.h"
+#include "movie.h"
+#include "search.h"
+#include "ttable.h"
+
+// states are sent as a delta against the root state, XOR'd and with zero runs collapsed
+// runs of equal bytes shorter than this are kept as literals, as a run costs a couple of varints
+#define SEARCH_MIN_ZERO_RUN 8
+
+enum {
+	SEARCH_MSG_ROOT,
+	SEARCH_MSG_EXPAND,
+	SEARCH_MSG_EXIT,
+};
+
+typedef struct {
+	uint32_t type;
+	uint64_t length; // payload length, root state for ROOT, compressed state for EXPAND
+} search_msg_t;
+
+// the worker answers an EXPAND with one of these per alphabet input, each followed by the compressed state
+typedef struct {
+	uint32_t score;
+	uint32_t goal;
+	uint32_t skipped; // the first input was only used on lag frames, so the others would play out the same
+	hash128_t hash; // of the transposition table domains
+	uint64_t length;
+} search_child_msg_t;
+
+typedef struct {
+	uint8_t* data;
+	uintptr_t length;
+	uintptr_t capacity;
+} search_buf_t;
+
+typedef struct {
+	uint32_t parent;
+	uint8_t input;
+	uint32_t score;
+	bool goal;
+} search_node_t;
+
+typedef struct {
+	uint32_t node;
+	uint32_t score;
+	hash128_t hash;
+	bool skipped;
+	search_buf_t state; // compressed
+} search_beam_entry_t;
+
+typedef struct {
+	pid_t pid;
+	int fd;
+	uint32_t slot; // beam entry being expanded, UINT32_MAX if idle
+} search_worker_t;
+
+struct search_t {
+	search_config_t config;
+	uint8_t* alphabet;
+	search_worker_t* workers;
+	search_node_t* nodes;
+	uint32_t num_nodes;
+	uint32_t nodes_capacity;
+	ttable_t* ttable;
+};
+
+static void search_buf_reserve(search_buf_t* buf, uintptr_t length) {
+	if (length > buf->capacity) {
+		buf->capacity = length + length / 2;
+		buf->data = ralloc(buf->data, buf->capacity);
+	}
+}
+
+static void search_buf_put_varint(search_buf_t* buf, uint64_t value) {
+	search_buf_reserve(buf, buf->length + 10);
+	while (value >= 0x80) {
+		buf->data[buf->length++] = value | 0x80;
+		value >>= 7;
+	}
+	buf->data[buf->length++] = value;
+}
+
+static uint64_t search_get_varint(const uint8_t** p, const uint8_t* end) {
+	uint64_t value = 0;
+	for (uint32_t shift = 0; *p < end && shift < 64; shift += 7) {
+		uint8_t byte = *(*p)++;
+		value |= (uint64_t)(byte & 0x7F) << shift;
+		if (!(byte & 0x80)) {
+			return value;
+		}
+	}
+
+	FATAL_ERROR("Corrupt compressed search state");
+	return 0;
+}
+
+static inline uint8_t search_delta(const uint8_t* state, const uint8_t* root, uintptr_t root_length, uintptr_t i) {
+	return state[i] ^ (i < root_length ? root[i] : 0);
+}
+
+static void search_compress(search_buf_t* out, const uint8_t* state, uintptr_t length, const uint8_t* root, uintptr_t root_length) {
+	out->length = 0;
+	search_buf_put_varint(out, length);
+
+	uintptr_t common = length < root_length ? length : root_length;
+	uintptr_t i = 0;
+	while (i < length) {
+		// zero run, compared a word at a time as most of the state usually matches the root
+		uintptr_t start = i;
+		while (i + 8 <= common && !memcmp(state + i, root + i, 8)) {
+			i += 8;
+		}
+		while (i < length && !search_delta(state, root, root_length, i)) {
+			i++;
+		}
+		search_buf_put_varint(out, i - start);
+
+		// literal run, until enough zeros are seen to be worth a new run
+		start = i;
+		uint32_t zeros = 0;
+		while (i < length && zeros < SEARCH_MIN_ZERO_RUN) {
+			zeros = search_delta(state, root, root_length, i) ? 0 : zeros + 1;
+			i++;
+		}
+		if (zeros == SEARCH_MIN_ZERO_RUN) {
+			i -= SEARCH_MIN_ZERO_RUN;
+		}
+
+		search_buf_put_varint(out, i - start);
+		search_buf_reserve(out, out->length + (i - start));
+		for (uintptr_t j = start; j < i; j++) {
+			out->data[out->length++] = search_delta(state, root, root_length, j);
+		}
+	}
+}
+
+static void search_decompress(search_buf_t* out, const uint8_t* data, uintptr_t data_length, const uint8_t* root, uintptr_t root_length) {
+	const uint8_t* p = data;
+	const uint8_t* end = data + data_length;
+	uintptr_t length = search_get_varint(&p, end);
+	search_buf_reserve(out, length);
+	out->length = length;
+
+	uintptr_t i = 0;
+	while (i < length) {
+		uintptr_t zeros = search_get_varint(&p, end);
+		uintptr_t literals = search_get_varint(&p, end);
+		if (zeros + literals > length - i || literals > (uintptr_t)(end - p)) {
+			FATAL_ERROR("Corrupt compressed search state");
+		}
+
+		for (uintptr_t stop = i + zeros; i < stop; i++) {
+			out->data[i] = i < root_length ? root[i] : 0;
+		}
+
+		for (uintptr_t stop = i + literals; i < stop; i++) {
+			out->data[i] = *p++ ^ (i < root_length ? root[i] : 0);
+		}
+	}
+}
+
+static void search_write_all(int fd, const void* data, uintptr_t length) {
+	const uint8_t* p = data;
+	while (length) {
+		ssize_t ret = send(fd, p, length, MSG_NOSIGNAL);
+		if (ret <= 0) {
+			FATAL_ERROR("Failed to send search message");
+		}
+		p += ret;
+		length -= ret;
+	}
+}
+
+static bool search_read_all(int fd, void* data, uintptr_t length) {
+	uint8_t* p = data;
+	while (length) {
+		ssize_t ret = read(fd, p, length);
+		if (ret <= 0) {
+			return false;
+		}
+		p += ret;
+		length -= ret;
+	}
+
+	return true;
+}
+
+static void search_send(int fd, uint32_t type, const void* payload, uint64_t length) {
+	search_msg_t msg;
+	msg.type = type;
+	msg.length = length;
+	search_write_all(fd, &msg, sizeof(search_msg_t));
+	search_write_all(fd, payload, length);
+}
+
+static void search_worker_main(search_t* search, int fd) {
+	core_t* core = search->config.create_core(search->config.userdata);
+	gpgx_impl_t* impl = (gpgx_impl_t*)core;
+	wbx_impl_enter(impl->wbx);
+
+	trigger_t* score = gpgx_impl_compile_trigger(core, search->config.score);
+	trigger_t* goal = search->config.goal ? gpgx_impl_compile_trigger(core, search->config.goal) : NULL;
+	trigger_t** inputs = salloc(sizeof(trigger_t*) * search->config.alphabet_len);
+	for (uint32_t i = 0; i < search->config.alphabet_len; i++) {
+		char expr[16];
+		snprintf(expr, sizeof(expr), "%u", search->alphabet[i]);
+		inputs[i] = gpgx_impl_compile_trigger(core, expr);
+	}
+
+	// 68K RAM unless other domains are given
+	uint32_t num_domains = search->config.num_ttable_domains ? search->config.num_ttable_domains : 1;
+	const uint8_t** domains = salloc(sizeof(uint8_t*) * num_domains);
+	uint32_t* domain_sizes = salloc(sizeof(uint32_t) * num_domains);
+	for (uint32_t i = 0; i < num_domains; i++) {
+		const char* name = search->config.num_ttable_domains ? search->config.ttable_domains[i] : "68K RAM";
+		domains[i] = gpgx_impl_get_memdom(core, name, &domain_sizes[i]);
+		if (!domains[i]) {
+			FATAL_ERROR("Could not find memory domain %s for the search", name);
+		}
+	}
+
+	search_buf_t root = { 0 };
+	search_buf_t msg_state = { 0 };
+	search_buf_t state = { 0 };
+	search_buf_t child = { 0 };
+	search_msg_t msg;
+	while (search_read_all(fd, &msg, sizeof(search_msg_t)) && msg.type != SEARCH_MSG_EXIT) {
+		search_buf_t* dst = msg.type == SEARCH_MSG_ROOT ? &root : &msg_state;
+		search_buf_reserve(dst, msg.length);
+		dst->length = msg.length;
+		if (!search_read_all(fd, dst->data, msg.length)) {
+			break;
+		}
+
+		if (msg.type != SEARCH_MSG_EXPAND) {
+			continue;
+		}
+
+		search_decompress(&state, msg_state.data, msg_state.length, root.data, root.length);
+		bool lagged = false;
+		for (uint32_t i = 0; i < search->config.alphabet_len; i++) {
+			search_child_msg_t reply;
+			if (lagged) {
+				memset(&reply, 0, sizeof(search_child_msg_t));
+				reply.skipped = 1;
+				search_write_all(fd, &reply, sizeof(search_child_msg_t));
+				continue;
+			}
+
+			gpgx_impl_load_state(core, state.data, state.length);
+			uint64_t lag_frames = impl->lag_frames;
+			gpgx_impl_run_until(core, NULL, inputs[i], search->config.frames_per_input, NULL, NULL);
+			lagged = impl->lag_frames - lag_frames == search->config.frames_per_input;
+
+			uintptr_t child_len;
+			void* child_state = gpgx_impl_save_state(core, &child_len);
+			search_compress(&child, child_state, child_len, root.data, root.length);
+			free(child_state);
+
+			reply.score = trigger_eval(score);
+			reply.goal = goal ? trigger_eval(goal) != 0 : 0;
+			reply.skipped = 0;
+			reply.hash.lo = reply.hash.hi = 0;
+			for (uint32_t j = 0; j < num_domains; j++) {
+				reply.hash = hash_128(domains[j], domain_sizes[j], reply.hash.lo ^ reply.hash.hi);
+			}
+			reply.length = child.length;
+			search_write_all(fd, &reply, sizeof(search_child_msg_t));
+			search_write_all(fd, child.data, child.length);
+		}
+	}
+
+	free(domains);
+	free(domain_sizes);
+	free(root.data);
+	free(msg_state.data);
+	free(state.data);
+	free(child.data);
+	for (uint32_t i = 0; i < search->config.alphabet_len; i++) {
+		trigger_destroy(inputs[i]);
+	}
+	free(inputs);
+	trigger_destroy(score);
+	if (goal) {
+		trigger_destroy(goal);
+	}
+
+	wbx_impl_exit(impl->wbx);
+	core->destroy(core);
+}
+
+search_t* search_create(const search_config_t* config) {
+	if (!config->alphabet_len || config->alphabet_len > 256 || !config->beam_width || !config->num_workers) {
+		FATAL_ERROR("Invalid search config");
+	}
+
+	search_t* search = zalloc(sizeof(search_t));
+	search->config = *config;
+	search->alphabet = salloc(config->alphabet_len);
+	memcpy(search->alphabet, config->alphabet, config->alphabet_len);
+	search->workers = salloc(sizeof(search_worker_t) * config->num_workers);
+	if (config->ttable_size) {
+		search->ttable = ttable_create(config->ttable_size);
+	}
+
+	// anything buffered would otherwise be written out by each worker too
+	fflush(stdout);
+	fflush(stderr);
+
+	for (uint32_t i = 0; i < config->num_workers; i++) {
+		int fds[2];
+		if (socketpair(AF_UNIX, SOCK_STREAM, 0, fds)) {
+			FATAL_ERROR("Failed to create search worker socket");
+		}
+
+		pid_t pid = fork();
+		if (pid < 0) {
+			FATAL_ERROR("Failed to fork search worker");
+		}
+
+		if (!pid) {
+			// only keep our own end, so other workers see EOF if the parent goes away
+			for (uint32_t j = 0; j < i; j++) {
+				close(search->workers[j].fd);
+			}
+			close(fds[0]);
+			search_worker_main(search, fds[1]);
+			_exit(0);
+		}
+
+		close(fds[1]);
+		search->workers[i].pid = pid;
+		search->workers[i].fd = fds[0];
+		search->workers[i].slot = UINT32_MAX;
+	}
+
+	return search;
+}
+
+void search_destroy(search_t* search) {
+	for (uint32_t i = 0; i < search->config.num_workers; i++) {
+		search_send(search->workers[i].fd, SEARCH_MSG_EXIT, NULL, 0);
+		close(search->workers[i].fd);
+		waitpid(search->workers[i].pid, NULL, 0);
+	}
+
+	if (search->ttable) {
+		ttable_destroy(search->ttable);
+	}
+	free(search->workers);
+	free(search->alphabet);
+	free(search->nodes);
+	free(search);
+}
+
+static void search_receive_children(search_t* search, search_worker_t* worker, search_beam_entry_t* children, uint32_t first_node) {
+	for (uint32_t i = 0; i < search->config.alphabet_len; i++) {
+		uint32_t slot = worker->slot * search->config.alphabet_len + i;
+		search_child_msg_t reply;
+		if (!search_read_all(worker->fd, &reply, sizeof(search_child_msg_t))) {
+			FATAL_ERROR("Search worker %d exited unexpectedly", worker->pid);
+		}
+
+		search_buf_t* state = &children[slot].state;
+		search_buf_reserve(state, reply.length);
+		state->length = reply.length;
+		if (!search_read_all(worker->fd, state->data, reply.length)) {
+			FATAL_ERROR("Search worker %d exited unexpectedly", worker->pid);
+		}
+
+		search_node_t* node = &search->nodes[first_node + slot];
+		node->score = reply.score;
+		node->goal = reply.goal;
+		children[slot].score = reply.score;
+		children[slot].hash = reply.hash;
+		children[slot].skipped = reply.skipped;
+	}
+
+	worker->slot = UINT32_MAX;
+}
+
+static int search_compare_entries(const void* a, const void* b) {
+	const search_beam_entry_t* entry_a = a;
+	const search_beam_entry_t* entry_b = b;
+	if (entry_a->score != entry_b->score) {
+		return entry_a->score > entry_b->score ? -1 : 1;
+	}
+
+	// ties go to the earlier node, which keeps the search deterministic regardless of worker timing
+	return entry_a->node < entry_b->node ? -1 : entry_a->node > entry_b->node;
+}
+
+static double search_get_time(void) {
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+void search_run(search_t* search, void* state, uintptr_t length, search_result_t* result) {
+	double start_time = search_get_time();
+	const uint32_t alphabet_len = search->config.alphabet_len;
+
+	for (uint32_t i = 0; i < search->config.num_workers; i++) {
+		search_send(search->workers[i].fd, SEARCH_MSG_ROOT, state, length);
+	}
+
+	search->num_nodes = 1;
+	search->nodes = ralloc(search->nodes, sizeof(search_node_t));
+	search->nodes_capacity = 1;
+	search->nodes[0].parent = UINT32_MAX;
+	search->nodes[0].score = 0;
+	search->nodes[0].goal = false;
+
+	search_beam_entry_t* beam = zalloc(sizeof(search_beam_entry_t));
+	uint32_t beam_len = 1;
+	search_compress(&beam[0].state, state, length, state, length);
+
+	if (search->ttable) {
+		ttable_clear(search->ttable);
+	}
+
+	uint32_t best = 0;
+	result->reached_goal = false;
+	result->nodes = 0;
+	for (uint32_t depth = 0; depth < search->config.horizon && !result->reached_goal; depth++) {
+		// children get node ids in slot order, so ids don't depend on which worker finishes first
+		uint32_t num_children = beam_len * alphabet_len;
+		uint32_t first_node = search->num_nodes;
+		search->num_nodes += num_children;
+		if (search->num_nodes > search->nodes_capacity) {
+			search->nodes_capacity = search->num_nodes * 2;
+			search->nodes = ralloc(search->nodes, sizeof(search_node_t) * search->nodes_capacity);
+		}
+
+		search_beam_entry_t* children = zalloc(sizeof(search_beam_entry_t) * num_children);
+		for (uint32_t i = 0; i < num_children; i++) {
+			children[i].node = first_node + i;
+			search->nodes[first_node + i].parent = beam[i / alphabet_len].node;
+			search->nodes[first_node + i].input = search->alphabet[i % alphabet_len];
+		}
+
+		uint32_t next = 0;
+		uint32_t pending = 0;
+		struct pollfd* fds = salloc(sizeof(struct pollfd) * search->config.num_workers);
+		while (next < beam_len || pending) {
+			for (uint32_t i = 0; i < search->config.num_workers && next < beam_len; i++) {
+				search_worker_t* worker = &search->workers[i];
+				if (worker->slot == UINT32_MAX) {
+					worker->slot = next;
+					search_send(worker->fd, SEARCH_MSG_EXPAND, beam[next].state.data, beam[next].state.length);
+					next++;
+					pending++;
+				}
+			}
+
+			for (uint32_t i = 0; i < search->config.num_workers; i++) {
+				fds[i].fd = search->workers[i].slot == UINT32_MAX ? -1 : search->workers[i].fd;
+				fds[i].events = POLLIN;
+				fds[i].revents = 0;
+			}
+
+			if (poll(fds, search->config.num_workers, -1) < 0) {
+				FATAL_ERROR("Failed to poll search workers");
+			}
+
+			for (uint32_t i = 0; i < search->config.num_workers; i++) {
+				if (fds[i].revents) {
+					search_receive_children(search, &search->workers[i], children, first_node);
+					pending--;
+				}
+			}
+		}
+		free(fds);
+
+		for (uint32_t i = 0; i < beam_len; i++) {
+			free(beam[i].state.data);
+		}
+		free(beam);
+
+		// drop children skipped for lag, and those which converged on a state already reached at the same depth or sooner
+		// done in slot order after everything is received, again so worker timing doesn't matter
+		uint32_t kept = 0;
+		uint64_t frame = (uint64_t)(depth + 1) * search->config.frames_per_input;
+		for (uint32_t i = 0; i < num_children; i++) {
+			result->nodes += !children[i].skipped;
+			if (children[i].skipped || (search->ttable && ttable_check(search->ttable, children[i].hash, frame))) {
+				free(children[i].state.data);
+			} else {
+				children[kept++] = children[i];
+			}
+		}
+		num_children = kept;
+
+		if (!num_children) {
+			free(children);
+			beam = NULL;
+			beam_len = 0;
+			break;
+		}
+
+		qsort(children, num_children, sizeof(search_beam_entry_t), search_compare_entries);
+		best = children[0].node;
+		for (uint32_t i = 0; i < num_children; i++) {
+			if (search->nodes[children[i].node].goal) {
+				best = children[i].node;
+				result->reached_goal = true;
+				break;
+			}
+		}
+
+		beam_len = num_children < search->config.beam_width ? num_children : search->config.beam_width;
+		for (uint32_t i = beam_len; i < num_children; i++) {
+			free(children[i].state.data);
+		}
+		beam = children;
+	}
+
+	for (uint32_t i = 0; i < beam_len; i++) {
+		free(beam[i].state.data);
+	}
+	free(beam);
+
+	result->num_inputs = 0;
+	for (uint32_t node = best; node; node = search->nodes[node].parent) {
+		result->num_inputs++;
+	}
+
+	result->inputs = salloc(result->num_inputs ? result->num_inputs : 1);
+	uint32_t i = result->num_inputs;
+	for (uint32_t node = best; node; node = search->nodes[node].parent) {
+		result->inputs[--i] = search->nodes[node].input;
+	}
+
+	result->score = search->nodes[best].score;
+	result->seconds = search_get_time() - start_time;
+	printf("Search evaluated %ld nodes in %.2f seconds (%.0f nodes/s), best score %u over %u inputs%s\n",
+		result->nodes, result->seconds, result->nodes / result->seconds, result->score, result->num_inputs,
+		result->reached_goal ? " (goal reached)" : "");
+	fflush(stdout);
+
+	if (search->ttable) {
+		ttable_print_stats(search->ttable, "Search");
+	}
+}
+
+void search_free_result(search_result_t* result) {
+	free(result->inputs);
+	result->inputs = NULL;
+}
+
+void search_write_movie(search_t* search, const search_result_t* result, const char* path) {
+	movie_writer_t* movie = movie_writer_create(path);
+	for (uint32_t i = 0; i < result->num_inputs; i++) {
+		movie_writer_append(movie, result->inputs[i], search->config.frames_per_input);
+	}
+	movie_writer_destroy(movie);
+}
@@ -0,0 +1,51 @@
+#ifndef _SEARCH_H_
+#define _SEARCH_H_
+
+#include <stdint.h>
+#include <stdbool.h>
+
+#include "core.h"
+
+// beam search over inputs, nodes are savestates which are expanded in parallel by a pool of worker processes
+// each worker has its own core, as only one wbx instance can run in a process at a time
+
+typedef struct {
+	core_t* (*create_core)(void* userdata); // called once in each worker, should return a ready (not entered) core
+	void* userdata;
+	const uint8_t* alphabet; // pad inputs tried from each node
+	uint32_t alphabet_len;
+	uint32_t frames_per_input; // how many frames each input is held for
+	const char* score; // trigger over 68K RAM, evaluated after each input, higher is better
+	const char* goal; // optional trigger, the search stops at the first depth where a node satisfies it
+	uint32_t horizon; // maximum number of inputs in a path
+	uint32_t beam_width; // nodes kept at each depth
+	uint32_t num_workers;
+	uint32_t ttable_size; // transposition table entries, 0 to not prune converging branches
+	const char* const* ttable_domains; // memory domains hashed for the transposition table, 68K RAM if there are none
+	uint32_t num_ttable_domains;
+} search_config_t;
+
+typedef struct {
+	uint8_t* inputs; // best path, one input per step (each held for frames_per_input frames)
+	uint32_t num_inputs;
+	uint32_t score;
+	bool reached_goal;
+	uint64_t nodes; // nodes evaluated
+	double seconds;
+} search_result_t;
+
+struct search_t;
+typedef struct search_t search_t;
+
+// forks the workers, so this must be called while no core is entered (and ideally before other threads are started)
+search_t* search_create(const search_config_t* config);
+void search_destroy(search_t* search);
+
+// searches from state, which is not taken ownership of
+void search_run(search_t* search, void* state, uintptr_t length, search_result_t* result);
+void search_free_result(search_result_t* result);
+
+// writes the best path out as a standalone movie fragment
+void search_write_movie(search_t* search, const search_result_t* result, const char* path);
+
+#endif
@@ -0,0 +1,333 @@
+#include <ctype.h>
+
+#include "alloc.h"
+#include "fatal_error.h"
+#include "trigger.h"
+
+#define TRIGGER_MAX_STACK 32
+
+typedef enum {
+	TRIGGER_OP_END,
+	TRIGGER_OP_CONST,
+	TRIGGER_OP_LOAD8,
+	TRIGGER_OP_LOAD16_BE,
+	TRIGGER_OP_LOAD32_BE,
+	TRIGGER_OP_LOAD16_WORD,
+	TRIGGER_OP_LOAD32_WORD,
+	TRIGGER_OP_NOT,
+	TRIGGER_OP_INV,
+	TRIGGER_OP_NEG,
+	TRIGGER_OP_ADD,
+	TRIGGER_OP_SUB,
+	TRIGGER_OP_AND,
+	TRIGGER_OP_OR,
+	TRIGGER_OP_XOR,
+	TRIGGER_OP_EQ,
+	TRIGGER_OP_NE,
+	TRIGGER_OP_LT,
+	TRIGGER_OP_LE,
+	TRIGGER_OP_GT,
+	TRIGGER_OP_GE,
+	TRIGGER_OP_LAND,
+	TRIGGER_OP_LOR,
+	TRIGGER_OP_SELECT,
+} trigger_op_type_t;
+
+typedef struct {
+	trigger_op_type_t type;
+	union {
+		uint32_t imm;
+		const uint8_t* ptr;
+	};
+} trigger_op_t;
+
+struct trigger_t {
+	trigger_op_t* ops;
+	uint32_t num_ops;
+};
+
+typedef struct {
+	const char* expr;
+	const char* pos;
+	trigger_t* trigger;
+	const uint8_t* mem;
+	uint32_t mem_size;
+	bool word_swapped;
+	uint32_t depth;
+} trigger_parser_t;
+
+#define TRIGGER_PARSE_ERROR(parser, msg) FATAL_ERROR("Trigger error at column %ld: %s (in \"%s\")", \
+	(long)((parser)->pos - (parser)->expr) + 1, msg, (parser)->expr)
+
+static void trigger_emit(trigger_parser_t* parser, trigger_op_type_t type, uint32_t imm, const uint8_t* ptr) {
+	trigger_t* trigger = parser->trigger;
+	trigger->ops = ralloc(trigger->ops, sizeof(trigger_op_t) * (trigger->num_ops + 1));
+	trigger_op_t* op = &trigger->ops[trigger->num_ops++];
+	op->type = type;
+	if (ptr) {
+		op->ptr = ptr;
+	} else {
+		op->imm = imm;
+	}
+
+	// track stack usage, so eval never has to bounds check
+	switch (type) {
+		case TRIGGER_OP_END:
+		case TRIGGER_OP_NOT:
+		case TRIGGER_OP_INV:
+		case TRIGGER_OP_NEG:
+			break;
+		case TRIGGER_OP_CONST:
+		case TRIGGER_OP_LOAD8:
+		case TRIGGER_OP_LOAD16_BE:
+		case TRIGGER_OP_LOAD32_BE:
+		case TRIGGER_OP_LOAD16_WORD:
+		case TRIGGER_OP_LOAD32_WORD:
+			if (++parser->depth > TRIGGER_MAX_STACK) {
+				TRIGGER_PARSE_ERROR(parser, "expression too deep");
+			}
+			break;
+		case TRIGGER_OP_SELECT:
+			parser->depth -= 2;
+			break;
+		default:
+			parser->depth--;
+			break;
+	}
+}
+
+static void trigger_skip_space(trigger_parser_t* parser) {
+	while (isspace((unsigned char)*parser->pos)) {
+		parser->pos++;
+	}
+}
+
+static bool trigger_accept(trigger_parser_t* parser, const char* token) {
+	trigger_skip_space(parser);
+	size_t len = strlen(token);
+	if (strncmp(parser->pos, token, len)) {
+		return false;
+	}
+
+	// don't let < match the start of <= (and so on)
+	if (len == 1 && (token[0] == '<' || token[0] == '>' || token[0] == '!' || token[0] == '=') && parser->pos[1] == '=') {
+		return false;
+	}
+
+	if (len == 1 && (token[0] == '&' || token[0] == '|') && parser->pos[1] == token[0]) {
+		return false;
+	}
+
+	parser->pos += len;
+	return true;
+}
+
+static void trigger_expect(trigger_parser_t* parser, const char* token) {
+	if (!trigger_accept(parser, token)) {
+		TRIGGER_PARSE_ERROR(parser, "unexpected token");
+	}
+}
+
+static uint32_t trigger_parse_number(trigger_parser_t* parser) {
+	trigger_skip_space(parser);
+	if (!isdigit((unsigned char)*parser->pos)) {
+		TRIGGER_PARSE_ERROR(parser, "expected a number");
+	}
+
+	char* end;
+	unsigned long long val = strtoull(parser->pos, &end, 0);
+	if (val > UINT32_MAX) {
+		TRIGGER_PARSE_ERROR(parser, "number out of range");
+	}
+
+	parser->pos = end;
+	return (uint32_t)val;
+}
+
+static void trigger_parse_load(trigger_parser_t* parser, uint32_t width) {
+	trigger_expect(parser, "[");
+	uint32_t addr = trigger_parse_number(parser);
+	if ((uint64_t)addr + width > parser->mem_size) {
+		TRIGGER_PARSE_ERROR(parser, "read out of bounds");
+	}
+	trigger_expect(parser, "]");
+
+	if (width == 1) {
+		trigger_emit(parser, TRIGGER_OP_LOAD8, 0, &parser->mem[parser->word_swapped ? addr ^ 1 : addr]);
+	} else if (parser->word_swapped) {
+		if (addr & 1) {
+			TRIGGER_PARSE_ERROR(parser, "unaligned word read");
+		}
+		trigger_emit(parser, width == 2 ? TRIGGER_OP_LOAD16_WORD : TRIGGER_OP_LOAD32_WORD, 0, &parser->mem[addr]);
+	} else {
+		trigger_emit(parser, width == 2 ? TRIGGER_OP_LOAD16_BE : TRIGGER_OP_LOAD32_BE, 0, &parser->mem[addr]);
+	}
+}
+
+static void trigger_parse_ternary(trigger_parser_t* parser);
+
+static void trigger_parse_primary(trigger_parser_t* parser) {
+	if (trigger_accept(parser, "(")) {
+		trigger_parse_ternary(parser);
+		trigger_expect(parser, ")");
+	} else if (trigger_accept(parser, "u8")) {
+		trigger_parse_load(parser, 1);
+	} else if (trigger_accept(parser, "u16")) {
+		trigger_parse_load(parser, 2);
+	} else if (trigger_accept(parser, "u32")) {
+		trigger_parse_load(parser, 4);
+	} else {
+		trigger_emit(parser, TRIGGER_OP_CONST, trigger_parse_number(parser), NULL);
+	}
+}
+
+static void trigger_parse_unary(trigger_parser_t* parser) {
+	if (trigger_accept(parser, "!")) {
+		trigger_parse_unary(parser);
+		trigger_emit(parser, TRIGGER_OP_NOT, 0, NULL);
+	} else if (trigger_accept(parser, "~")) {
+		trigger_parse_unary(parser);
+		trigger_emit(parser, TRIGGER_OP_INV, 0, NULL);
+	} else if (trigger_accept(parser, "-")) {
+		trigger_parse_unary(parser);
+		trigger_emit(parser, TRIGGER_OP_NEG, 0, NULL);
+	} else {
+		trigger_parse_primary(parser);
+	}
+}
+
+// binary operators, from lowest to highest precedence
+static const struct {
+	const char* tokens[4];
+	trigger_op_type_t types[4];
+} trigger_binary_levels[] = {
+	{ { "||" }, { TRIGGER_OP_LOR } },
+	{ { "&&" }, { TRIGGER_OP_LAND } },
+	{ { "|" }, { TRIGGER_OP_OR } },
+	{ { "^" }, { TRIGGER_OP_XOR } },
+	{ { "&" }, { TRIGGER_OP_AND } },
+	{ { "==", "!=" }, { TRIGGER_OP_EQ, TRIGGER_OP_NE } },
+	{ { "<=", ">=", "<", ">" }, { TRIGGER_OP_LE, TRIGGER_OP_GE, TRIGGER_OP_LT, TRIGGER_OP_GT } },
+	{ { "+", "-" }, { TRIGGER_OP_ADD, TRIGGER_OP_SUB } },
+};
+
+#define TRIGGER_NUM_BINARY_LEVELS (sizeof(trigger_binary_levels) / sizeof(trigger_binary_levels[0]))
+
+static void trigger_parse_binary(trigger_parser_t* parser, uint32_t level) {
+	if (level == TRIGGER_NUM_BINARY_LEVELS) {
+		trigger_parse_unary(parser);
+		return;
+	}
+
+	trigger_parse_binary(parser, level + 1);
+
+	bool matched;
+	do {
+		matched = false;
+		for (uint32_t i = 0; i < 4 && trigger_binary_levels[level].tokens[i]; i++) {
+			if (trigger_accept(parser, trigger_binary_levels[level].tokens[i])) {
+				trigger_parse_binary(parser, level + 1);
+				trigger_emit(parser, trigger_binary_levels[level].types[i], 0, NULL);
+				matched = true;
+				break;
+			}
+		}
+	} while (matched);
+}
+
+static void trigger_parse_ternary(trigger_parser_t* parser) {
+	trigger_parse_binary(parser, 0);
+	if (trigger_accept(parser, "?")) {
+		trigger_parse_ternary(parser);
+		trigger_expect(parser, ":");
+		trigger_parse_ternary(parser);
+		trigger_emit(parser, TRIGGER_OP_SELECT, 0, NULL);
+	}
+}
+
+trigger_t* trigger_compile(const char* expr, const uint8_t* mem, uint32_t mem_size, bool word_swapped) {
+	trigger_parser_t parser;
+	parser.expr = expr;
+	parser.pos = expr;
+	parser.trigger = zalloc(sizeof(trigger_t));
+	parser.mem = mem;
+	parser.mem_size = mem_size;
+	parser.word_swapped = word_swapped;
+	parser.depth = 0;
+
+	trigger_parse_ternary(&parser);
+	trigger_skip_space(&parser);
+	if (*parser.pos) {
+		TRIGGER_PARSE_ERROR(&parser, "trailing characters");
+	}
+
+	trigger_emit(&parser, TRIGGER_OP_END, 0, NULL);
+	return parser.trigger;
+}
+
+void trigger_destroy(trigger_t* trigger) {
+	free(trigger->ops);
+	free(trigger);
+}
+
+uint32_t trigger_eval(const trigger_t* trigger) {
+	uint32_t stack[TRIGGER_MAX_STACK];
+	uint32_t* sp = stack; // points past the top of the stack
+
+	for (const trigger_op_t* op = trigger->ops;; op++) {
+		switch (op->type) {
+			case TRIGGER_OP_END:
+				return stack[0];
+			case TRIGGER_OP_CONST:
+				*sp++ = op->imm;
+				break;
+			case TRIGGER_OP_LOAD8:
+				*sp++ = *op->ptr;
+				break;
+			case TRIGGER_OP_LOAD16_BE:
+				*sp++ = (uint32_t)op->ptr[0] << 8 | op->ptr[1];
+				break;
+			case TRIGGER_OP_LOAD32_BE:
+				*sp++ = (uint32_t)op->ptr[0] << 24 | (uint32_t)op->ptr[1] << 16 | (uint32_t)op->ptr[2] << 8 | op->ptr[3];
+				break;
+			case TRIGGER_OP_LOAD16_WORD:
+				*sp++ = *(const uint16_t*)op->ptr;
+				break;
+			case TRIGGER_OP_LOAD32_WORD:
+				*sp++ = (uint32_t)*(const uint16_t*)op->ptr << 16 | *(const uint16_t*)&op->ptr[2];
+				break;
+			case TRIGGER_OP_NOT:
+				sp[-1] = !sp[-1];
+				break;
+			case TRIGGER_OP_INV:
+				sp[-1] = ~sp[-1];
+				break;
+			case TRIGGER_OP_NEG:
+				sp[-1] = -sp[-1];
+				break;
+			#define TRIGGER_BINARY_OP(type, expr) \
+			case type: \
+				sp--; \
+				sp[-1] = (expr); \
+				break;
+			TRIGGER_BINARY_OP(TRIGGER_OP_ADD, sp[-1] + sp[0])
+			TRIGGER_BINARY_OP(TRIGGER_OP_SUB, sp[-1] - sp[0])
+			TRIGGER_BINARY_OP(TRIGGER_OP_AND, sp[-1] & sp[0])
+			TRIGGER_BINARY_OP(TRIGGER_OP_OR, sp[-1] | sp[0])
+			TRIGGER_BINARY_OP(TRIGGER_OP_XOR, sp[-1] ^ sp[0])
+			TRIGGER_BINARY_OP(TRIGGER_OP_EQ, sp[-1] == sp[0])
+			TRIGGER_BINARY_OP(TRIGGER_OP_NE, sp[-1] != sp[0])
+			TRIGGER_BINARY_OP(TRIGGER_OP_LT, sp[-1] < sp[0])
+			TRIGGER_BINARY_OP(TRIGGER_OP_LE, sp[-1] <= sp[0])
+			TRIGGER_BINARY_OP(TRIGGER_OP_GT, sp[-1] > sp[0])
+			TRIGGER_BINARY_OP(TRIGGER_OP_GE, sp[-1] >= sp[0])
+			TRIGGER_BINARY_OP(TRIGGER_OP_LAND, sp[-1] && sp[0])
+			TRIGGER_BINARY_OP(TRIGGER_OP_LOR, sp[-1] || sp[0])
+			#undef TRIGGER_BINARY_OP
+			case TRIGGER_OP_SELECT:
+				sp -= 2;
+				sp[-1] = sp[-1] ? sp[0] : sp[1];
+				break;
+		}
+	}
+}
@@ -0,0 +1,17 @@
+#ifndef _TRIGGER_H_
+#define _TRIGGER_H_
+
+#include <stdint.h>
+#include <stdbool.h>
+
+struct trigger_t;
+typedef struct trigger_t trigger_t;
+
+// compiles an expression over a memory domain into flat bytecode, fatal error on a bad expression
+// reads are u8[addr], u16[addr], u32[addr] (big endian), combined with C operators (arithmetic, bitwise, comparison, !, &&, ||, ?:)
+// word_swapped is for domains stored as little endian 16-bit words (e.g. 68K RAM), where byte addr lives at addr ^ 1
+trigger_t* trigger_compile(const char* expr, const uint8_t* mem, uint32_t mem_size, bool word_swapped);
+void trigger_destroy(trigger_t* trigger);
+uint32_t trigger_eval(const trigger_t* trigger);
+
+#endif
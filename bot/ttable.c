@@ -0,0 +1,173 @@
+#include <stdio.h>
+
+#include "alloc.h"
+#include "fatal_error.h"
+#include "ttable.h"
+
+#define TTABLE_EMPTY UINT32_MAX
+
+typedef struct {
+	hash128_t hash;
+	uint64_t frame;
+	uint32_t prev; // LRU list, towards the most recently used
+	uint32_t next;
+} ttable_entry_t;
+
+// open addressing with linear probing over entry indices, entries are recycled from the LRU tail once full
+struct ttable_t {
+	ttable_entry_t* entries;
+	uint32_t num_entries;
+	uint32_t max_entries;
+	uint32_t* slots;
+	uint32_t slot_mask;
+	uint32_t head; // most recently used
+	uint32_t tail; // least recently used
+	ttable_stats_t stats;
+};
+
+ttable_t* ttable_create(uint32_t max_entries) {
+	if (!max_entries || max_entries > UINT32_MAX / 4) {
+		FATAL_ERROR("Invalid transposition table size %d", max_entries);
+	}
+
+	ttable_t* ttable = zalloc(sizeof(ttable_t));
+	ttable->max_entries = max_entries;
+	ttable->entries = salloc(sizeof(ttable_entry_t) * max_entries);
+
+	// keep the load factor at or under 1/2
+	uint32_t num_slots = 1;
+	while (num_slots < max_entries * 2) {
+		num_slots <<= 1;
+	}
+	ttable->slots = salloc(sizeof(uint32_t) * num_slots);
+	ttable->slot_mask = num_slots - 1;
+	ttable->stats.memory_used = sizeof(ttable_t) + sizeof(ttable_entry_t) * max_entries + sizeof(uint32_t) * num_slots;
+
+	ttable_clear(ttable);
+	return ttable;
+}
+
+void ttable_destroy(ttable_t* ttable) {
+	free(ttable->entries);
+	free(ttable->slots);
+	free(ttable);
+}
+
+void ttable_clear(ttable_t* ttable) {
+	memset(ttable->slots, 0xFF, sizeof(uint32_t) * (ttable->slot_mask + 1));
+	ttable->num_entries = 0;
+	ttable->head = TTABLE_EMPTY;
+	ttable->tail = TTABLE_EMPTY;
+}
+
+static void ttable_unlink(ttable_t* ttable, uint32_t index) {
+	ttable_entry_t* entry = &ttable->entries[index];
+	if (entry->prev != TTABLE_EMPTY) {
+		ttable->entries[entry->prev].next = entry->next;
+	} else {
+		ttable->head = entry->next;
+	}
+
+	if (entry->next != TTABLE_EMPTY) {
+		ttable->entries[entry->next].prev = entry->prev;
+	} else {
+		ttable->tail = entry->prev;
+	}
+}
+
+static void ttable_push_head(ttable_t* ttable, uint32_t index) {
+	ttable_entry_t* entry = &ttable->entries[index];
+	entry->prev = TTABLE_EMPTY;
+	entry->next = ttable->head;
+	if (ttable->head != TTABLE_EMPTY) {
+		ttable->entries[ttable->head].prev = index;
+	} else {
+		ttable->tail = index;
+	}
+	ttable->head = index;
+}
+
+// removes the entry from the slots, shifting back any entries that probed past it
+static void ttable_remove_slot(ttable_t* ttable, uint32_t index) {
+	uint32_t slot = ttable->entries[index].hash.lo & ttable->slot_mask;
+	while (ttable->slots[slot] != index) {
+		slot = (slot + 1) & ttable->slot_mask;
+	}
+
+	uint32_t hole = slot;
+	while (true) {
+		slot = (slot + 1) & ttable->slot_mask;
+		uint32_t other = ttable->slots[slot];
+		if (other == TTABLE_EMPTY) {
+			break;
+		}
+
+		// an entry can fill the hole if the hole lies between its home slot and where it is now
+		uint32_t home = ttable->entries[other].hash.lo & ttable->slot_mask;
+		if (((slot - home) & ttable->slot_mask) >= ((slot - hole) & ttable->slot_mask)) {
+			ttable->slots[hole] = other;
+			hole = slot;
+		}
+	}
+
+	ttable->slots[hole] = TTABLE_EMPTY;
+}
+
+bool ttable_check(ttable_t* ttable, hash128_t hash, uint64_t frame) {
+	ttable->stats.lookups++;
+
+	uint32_t slot = hash.lo & ttable->slot_mask;
+	uint32_t index;
+	while ((index = ttable->slots[slot]) != TTABLE_EMPTY) {
+		ttable_entry_t* entry = &ttable->entries[index];
+		if (hash_equal(entry->hash, hash)) {
+			ttable_unlink(ttable, index);
+			ttable_push_head(ttable, index);
+			if (entry->frame <= frame) {
+				ttable->stats.hits++;
+				return true;
+			}
+
+			// reached sooner this time, so this branch is the better one
+			entry->frame = frame;
+			return false;
+		}
+
+		slot = (slot + 1) & ttable->slot_mask;
+	}
+
+	if (ttable->num_entries < ttable->max_entries) {
+		index = ttable->num_entries++;
+	} else {
+		index = ttable->tail;
+		ttable_unlink(ttable, index);
+		ttable_remove_slot(ttable, index);
+		ttable->stats.evictions++;
+
+		// the removal may have shifted entries into our probe sequence
+		slot = hash.lo & ttable->slot_mask;
+		while (ttable->slots[slot] != TTABLE_EMPTY) {
+			slot = (slot + 1) & ttable->slot_mask;
+		}
+	}
+
+	ttable->entries[index].hash = hash;
+	ttable->entries[index].frame = frame;
+	ttable_push_head(ttable, index);
+	ttable->slots[slot] = index;
+	return false;
+}
+
+void ttable_get_stats(ttable_t* ttable, ttable_stats_t* stats) {
+	*stats = ttable->stats;
+	stats->entries = ttable->num_entries;
+}
+
+void ttable_print_stats(ttable_t* ttable, const char* name) {
+	ttable_stats_t stats;
+	ttable_get_stats(ttable, &stats);
+	printf("%s transposition table: %ld / %ld hits (%.1f%%), %d entries, %ld evictions, %.1f MiB\n",
+		name, stats.hits, stats.lookups, stats.lookups ? stats.hits * 100.0 / stats.lookups : 0.0,
+		stats.entries, stats.evictions, stats.memory_used / (1024.0 * 1024.0));
+	fflush(stdout);
+}
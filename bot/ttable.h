@@ -0,0 +1,34 @@
+#ifndef _TTABLE_H_
+#define _TTABLE_H_
+
+#include <stdint.h>
+#include <stdbool.h>
+
+#include "hash.h"
+
+// transposition table of memory hashes seen while searching, bounded by evicting the least recently used entry
+// lets a search discard branches which converge onto a state it has already explored
+
+struct ttable_t;
+typedef struct ttable_t ttable_t;
+
+typedef struct {
+	uint64_t lookups;
+	uint64_t hits;
+	uint64_t evictions;
+	uint32_t entries;
+	uint64_t memory_used; // bytes
+} ttable_stats_t;
+
+ttable_t* ttable_create(uint32_t max_entries);
+void ttable_destroy(ttable_t* ttable);
+void ttable_clear(ttable_t* ttable); // stats are kept
+
+// returns true if the hash was already seen at an equal or earlier frame, in which case the branch should be discarded
+// otherwise, the hash is recorded as seen at this frame
+bool ttable_check(ttable_t* ttable, hash128_t hash, uint64_t frame);
+
+void ttable_get_stats(ttable_t* ttable, ttable_stats_t* stats);
+void ttable_print_stats(ttable_t* ttable, const char* name);
+
+#endif
@@ -0,0 +1,110 @@
+#ifndef __x86_64__
+#error This file can only be compiled under x86-64
+#endif
+
+#include <emmintrin.h>
+#include <string.h>
+
+#include "hash.h"
+
+// structured like xxh3: 8 64-bit lanes accumulate 64 byte stripes, scrambled every 1 KiB block
+#define HASH_STRIPE_LEN 64
+#define HASH_STRIPES_PER_BLOCK 16
+#define HASH_BLOCK_LEN (HASH_STRIPE_LEN * HASH_STRIPES_PER_BLOCK)
+
+#define HASH_PRIME32 0x9E3779B1U
+#define HASH_PRIME64_1 0x9E3779B185EBCA87ULL
+#define HASH_PRIME64_2 0xC2B2AE3D27D4EB4FULL
+
+// splitmix64 output, the first 184 bytes are used for stripes, the last 64 bytes for scrambling
+static const uint64_t hash_secret[24] __attribute__((aligned(16))) = {
+	0x855B5D4DE26FC220ULL, 0x7B0CE9CA7B995716ULL, 0x084E4973A7E92A41ULL, 0x1E747476DD8BC370ULL,
+	0xAE1DDF61669D854EULL, 0x91710B1AE64C36EFULL, 0x46B2FE642F638800ULL, 0xCCF2B33859226920ULL,
+	0xE5A1B8E80E313A36ULL, 0xB668E384E58F41D7ULL, 0x45E529E899796AB0ULL, 0x02275CAB6A271976ULL,
+	0x03BB80694825DF8BULL, 0x392B8D3C4E01E111ULL, 0x6D9D06B35B841C36ULL, 0xB5F6E490CB8FB3F0ULL,
+	0xD86FC9C7FF27364FULL, 0x9A64F8EE47691A59ULL, 0xAAA27B508B90FDD8ULL, 0x3D249FCF67644587ULL,
+	0x71E243B1DB4C4451ULL, 0xEAB952172C3AEEADULL, 0xF4D6524C90EF03DFULL, 0x596AFA4C04D9D6B3ULL,
+};
+
+static inline void hash_accumulate_stripe(__m128i acc[4], const uint8_t* data, const uint64_t* secret) {
+	for (uint32_t i = 0; i < 4; i++) {
+		__m128i d = _mm_loadu_si128((const __m128i*)(data + i * 16));
+		__m128i k = _mm_loadu_si128((const __m128i*)(secret + i * 2));
+		__m128i dk = _mm_xor_si128(d, k);
+		__m128i prod = _mm_mul_epu32(dk, _mm_shuffle_epi32(dk, _MM_SHUFFLE(0, 3, 0, 1))); // lo32 * hi32 of each lane
+		__m128i swapped = _mm_shuffle_epi32(d, _MM_SHUFFLE(1, 0, 3, 2)); // keep the input itself in the other lane
+		acc[i] = _mm_add_epi64(acc[i], _mm_add_epi64(prod, swapped));
+	}
+}
+
+static inline void hash_scramble(__m128i acc[4]) {
+	const __m128i prime = _mm_set1_epi32(HASH_PRIME32);
+	for (uint32_t i = 0; i < 4; i++) {
+		__m128i a = _mm_xor_si128(acc[i], _mm_srli_epi64(acc[i], 47));
+		a = _mm_xor_si128(a, _mm_load_si128((const __m128i*)&hash_secret[16 + i * 2]));
+		__m128i lo = _mm_mul_epu32(a, prime);
+		__m128i hi = _mm_mul_epu32(_mm_srli_epi64(a, 32), prime);
+		acc[i] = _mm_add_epi64(lo, _mm_slli_epi64(hi, 32));
+	}
+}
+
+static inline uint64_t hash_mul_fold(uint64_t a, uint64_t b) {
+	unsigned __int128 r = (unsigned __int128)a * b;
+	return (uint64_t)r ^ (uint64_t)(r >> 64);
+}
+
+static inline uint64_t hash_avalanche(uint64_t h) {
+	h ^= h >> 37;
+	h *= 0x165667919E3779F9ULL;
+	h ^= h >> 32;
+	return h;
+}
+
+static uint64_t hash_merge(const uint64_t acc[8], const uint64_t* secret, uint64_t start) {
+	uint64_t r = start;
+	for (uint32_t i = 0; i < 4; i++) {
+		r += hash_mul_fold(acc[i * 2] ^ secret[i * 2], acc[i * 2 + 1] ^ secret[i * 2 + 1]);
+	}
+	return hash_avalanche(r);
+}
+
+hash128_t hash_128(const void* data, size_t len, uint64_t seed) {
+	const uint8_t* p = data;
+	__m128i acc[4];
+	acc[0] = _mm_set_epi64x(HASH_PRIME64_1, seed);
+	acc[1] = _mm_set_epi64x(~seed, HASH_PRIME64_2);
+	acc[2] = _mm_set_epi64x(seed ^ HASH_PRIME64_2, HASH_PRIME64_1 + seed);
+	acc[3] = _mm_set_epi64x(HASH_PRIME32, seed * HASH_PRIME64_1);
+
+	size_t num_blocks = len / HASH_BLOCK_LEN;
+	for (size_t b = 0; b < num_blocks; b++) {
+		for (uint32_t s = 0; s < HASH_STRIPES_PER_BLOCK; s++) {
+			hash_accumulate_stripe(acc, p + s * HASH_STRIPE_LEN, hash_secret + s);
+		}
+		hash_scramble(acc);
+		p += HASH_BLOCK_LEN;
+	}
+
+	// tail stripes, the last one zero padded
+	size_t rem = len - num_blocks * HASH_BLOCK_LEN;
+	uint32_t s = 0;
+	for (; rem >= HASH_STRIPE_LEN; s++, rem -= HASH_STRIPE_LEN, p += HASH_STRIPE_LEN) {
+		hash_accumulate_stripe(acc, p, hash_secret + s);
+	}
+
+	if (rem) {
+		uint8_t last[HASH_STRIPE_LEN] = { 0 };
+		memcpy(last, p, rem);
+		hash_accumulate_stripe(acc, last, hash_secret + s);
+	}
+
+	uint64_t lanes[8] __attribute__((aligned(16)));
+	for (uint32_t i = 0; i < 4; i++) {
+		_mm_store_si128((__m128i*)&lanes[i * 2], acc[i]);
+	}
+
+	hash128_t ret;
+	ret.lo = hash_merge(lanes, hash_secret + 1, len * HASH_PRIME64_1);
+	ret.hi = hash_merge(lanes, hash_secret + 9, ~(len * HASH_PRIME64_2));
+	return ret;
+}
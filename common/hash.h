@@ -0,0 +1,20 @@
+#ifndef _HASH_H_
+#define _HASH_H_
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <stddef.h>
+
+typedef struct {
+	uint64_t lo;
+	uint64_t hi;
+} hash128_t;
+
+// fast non-cryptographic 128-bit hash (SSE2), meant for hashing emulator memory every frame
+hash128_t hash_128(const void* data, size_t len, uint64_t seed);
+
+static inline bool hash_equal(hash128_t a, hash128_t b) {
+	return a.lo == b.lo && a.hi == b.hi;
+}
+
+#endif
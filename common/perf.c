@@ -0,0 +1,176 @@
+#ifdef SLIMHAWK_PERF
+
+#define _GNU_SOURCE
+#include <errno.h>
+#include <linux/perf_event.h>
+#include <stdatomic.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <string.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+
+#include "perf.h"
+
+typedef enum {
+	PERF_CYCLES,
+	PERF_INSTRUCTIONS,
+	PERF_CACHE_MISSES,
+	PERF_BRANCH_MISSES,
+	PERF_NUM_COUNTERS,
+} perf_counter_t;
+
+static const uint64_t perf_counter_configs[PERF_NUM_COUNTERS] = {
+	PERF_COUNT_HW_CPU_CYCLES,
+	PERF_COUNT_HW_INSTRUCTIONS,
+	PERF_COUNT_HW_CACHE_MISSES,
+	PERF_COUNT_HW_BRANCH_MISSES,
+};
+
+static const char* const perf_stage_names[PERF_NUM_STAGES] = {
+	"other",
+	"emulation",
+	"scaling",
+	"encoding",
+	"disc-read",
+};
+
+// layout of a read() on the group leader
+typedef struct {
+	uint64_t nr;
+	uint64_t time_enabled;
+	uint64_t time_running;
+	uint64_t values[PERF_NUM_COUNTERS];
+} perf_read_t;
+
+typedef struct {
+	bool opened;
+	int leader; // -1 if the counters could not be opened
+	perf_stage_t stage;
+	uint64_t last[PERF_NUM_COUNTERS];
+} perf_thread_t;
+
+static _Atomic uint64_t perf_totals[PERF_NUM_STAGES][PERF_NUM_COUNTERS];
+static atomic_uint perf_threads;
+static atomic_uint perf_failed_threads;
+static atomic_bool perf_multiplexed;
+static _Thread_local perf_thread_t perf_thread;
+
+static int perf_open_counter(uint64_t config, int group) {
+	struct perf_event_attr attr;
+	memset(&attr, 0, sizeof(attr));
+	attr.size = sizeof(attr);
+	attr.type = PERF_TYPE_HARDWARE;
+	attr.config = config;
+	attr.read_format = PERF_FORMAT_GROUP | PERF_FORMAT_TOTAL_TIME_ENABLED | PERF_FORMAT_TOTAL_TIME_RUNNING;
+	// user space only, which is all that is allowed with the default perf_event_paranoid
+	attr.exclude_kernel = 1;
+	attr.exclude_hv = 1;
+	return syscall(SYS_perf_event_open, &attr, 0, -1, group, PERF_FLAG_FD_CLOEXEC);
+}
+
+static void perf_open(perf_thread_t* thread) {
+	thread->opened = true;
+	thread->leader = -1;
+
+	int fds[PERF_NUM_COUNTERS];
+	for (uint32_t i = 0; i < PERF_NUM_COUNTERS; i++) {
+		fds[i] = perf_open_counter(perf_counter_configs[i], i ? fds[0] : -1);
+		if (fds[i] < 0) {
+			int err = errno;
+			while (i--) {
+				close(fds[i]);
+			}
+
+			// only complain once, every other thread will fail the same way
+			if (!atomic_fetch_add(&perf_failed_threads, 1)) {
+				fprintf(stderr, "Could not open hardware performance counters: %s\n", strerror(err));
+			}
+			return;
+		}
+	}
+
+	thread->leader = fds[0];
+	atomic_fetch_add(&perf_threads, 1);
+}
+
+// charges everything counted since the last switch to the current stage, then moves to the new one
+static void perf_switch(perf_stage_t stage) {
+	perf_thread_t* thread = &perf_thread;
+	if (__builtin_expect(!thread->opened, false)) {
+		perf_open(thread);
+	}
+
+	if (thread->leader < 0) {
+		thread->stage = stage;
+		return;
+	}
+
+	perf_read_t counts;
+	if (read(thread->leader, &counts, sizeof(counts)) != sizeof(counts)) {
+		thread->stage = stage;
+		return;
+	}
+
+	// all of the counters are in one group, so they are either all scheduled or none are
+	// if the group was ever off the PMU the totals undercount, which is reported rather than scaled
+	if (counts.time_running != counts.time_enabled) {
+		atomic_store_explicit(&perf_multiplexed, true, memory_order_relaxed);
+	}
+
+	for (uint32_t i = 0; i < PERF_NUM_COUNTERS; i++) {
+		atomic_fetch_add_explicit(&perf_totals[thread->stage][i], counts.values[i] - thread->last[i], memory_order_relaxed);
+		thread->last[i] = counts.values[i];
+	}
+
+	thread->stage = stage;
+}
+
+perf_stage_t perf_enter(perf_stage_t stage) {
+	perf_stage_t resume = perf_thread.stage;
+	perf_switch(stage);
+	return resume;
+}
+
+void perf_leave(perf_stage_t resume) {
+	perf_switch(resume);
+}
+
+void perf_print(void) {
+	// charge the tail of the calling thread's current stage
+	perf_switch(perf_thread.stage);
+
+	uint32_t threads = atomic_load(&perf_threads);
+	if (!threads) {
+		printf("No hardware performance counters were collected\n");
+		return;
+	}
+
+	printf("Hardware performance counters (user space, %u threads):\n", threads);
+	printf("%-10s %16s %16s %6s %11s %12s\n", "stage", "cycles", "instructions", "IPC", "cache MPKI", "branch MPKI");
+	for (uint32_t i = 0; i < PERF_NUM_STAGES; i++) {
+		uint64_t totals[PERF_NUM_COUNTERS];
+		for (uint32_t j = 0; j < PERF_NUM_COUNTERS; j++) {
+			totals[j] = atomic_load(&perf_totals[i][j]);
+		}
+
+		if (!totals[PERF_INSTRUCTIONS]) {
+			continue;
+		}
+
+		double kilo_instructions = totals[PERF_INSTRUCTIONS] / 1000.0;
+		printf("%-10s %16lu %16lu %6.2f %11.3f %12.3f\n", perf_stage_names[i], totals[PERF_CYCLES], totals[PERF_INSTRUCTIONS],
+			totals[PERF_CYCLES] ? (double)totals[PERF_INSTRUCTIONS] / totals[PERF_CYCLES] : 0.0,
+			totals[PERF_CACHE_MISSES] / kilo_instructions, totals[PERF_BRANCH_MISSES] / kilo_instructions);
+	}
+
+	if (atomic_load(&perf_failed_threads)) {
+		printf("Counters could not be opened on %u threads, which are not included\n", atomic_load(&perf_failed_threads));
+	}
+
+	if (atomic_load(&perf_multiplexed)) {
+		printf("Counters were multiplexed with other events, so the totals are undercounted\n");
+	}
+}
+
+#endif
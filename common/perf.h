@@ -0,0 +1,40 @@
+#ifndef _PERF_H_
+#define _PERF_H_
+
+#include <stdint.h>
+
+// hardware counters (cycles, instructions, cache misses, branch misses) attributed to pipeline stages
+// opened per thread with perf_event_open, the totals for each stage are printed with IPC and MPKI at exit
+// only compiled in with SLIMHAWK_PERF, otherwise every macro here expands to nothing
+
+typedef enum {
+	PERF_STAGE_OTHER, // anything outside of a stage
+	PERF_STAGE_EMULATION,
+	PERF_STAGE_SCALING,
+	PERF_STAGE_ENCODING,
+	PERF_STAGE_DISC_READ,
+	PERF_NUM_STAGES,
+} perf_stage_t;
+
+#ifdef SLIMHAWK_PERF
+
+// stages nest, counts go to the innermost stage only (so a disc read during emulation is not also counted as emulation)
+// returns the stage which was interrupted, which must be passed to the matching perf_leave
+perf_stage_t perf_enter(perf_stage_t stage);
+void perf_leave(perf_stage_t resume);
+// only call once every counted thread is done
+void perf_print(void);
+
+#define PERF_ENTER(VAR, STAGE) perf_stage_t VAR = perf_enter(STAGE)
+#define PERF_LEAVE(VAR) perf_leave(VAR)
+#define PERF_PRINT() perf_print()
+
+#else
+
+#define PERF_ENTER(VAR, STAGE)
+#define PERF_LEAVE(VAR)
+#define PERF_PRINT()
+
+#endif
+
+#endif
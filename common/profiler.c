@@ -0,0 +1,196 @@
+#define _POSIX_C_SOURCE 200809L
+#include <signal.h>
+#include <stdio.h>
+#include <sys/time.h>
+
+#include "alloc.h"
+#include "fatal_error.h"
+#include "profiler.h"
+
+#define PROFILER_ADDR_BITS 24
+#define PROFILER_PAGE_BITS 8
+#define PROFILER_PAGE_SIZE (1 << PROFILER_PAGE_BITS)
+#define PROFILER_NUM_PAGES (1 << (PROFILER_ADDR_BITS - PROFILER_PAGE_BITS))
+
+typedef struct {
+	uint32_t addr;
+	uint32_t count;
+} profiler_entry_t;
+
+struct profiler_t {
+	uint32_t* pages[PROFILER_NUM_PAGES]; // hit counts, allocated a page at a time as they're first hit
+	uint32_t sample_every;
+	uint32_t countdown;
+	bool timer;
+	struct sigaction old_action;
+	uint64_t samples;
+	const profiler_region_t* regions;
+	uint32_t num_regions;
+};
+
+static volatile sig_atomic_t profiler_timer_fired;
+static bool profiler_timer_in_use;
+
+static void profiler_timer_handler(int sig) {
+	(void)sig;
+	profiler_timer_fired = 1;
+}
+
+static void profiler_set_timer(uint32_t hz) {
+	struct itimerval timer;
+	timer.it_interval.tv_sec = 0;
+	timer.it_interval.tv_usec = hz ? 1000000 / hz : 0;
+	timer.it_value = timer.it_interval;
+	if (setitimer(ITIMER_PROF, &timer, NULL)) {
+		FATAL_ERROR("Failed to set profiler timer");
+	}
+}
+
+profiler_t* profiler_create(uint32_t sample_every, uint32_t timer_hz, const profiler_region_t* regions, uint32_t num_regions) {
+	profiler_t* profiler = zalloc(sizeof(profiler_t));
+	profiler->sample_every = sample_every;
+	profiler->countdown = sample_every;
+	profiler->regions = regions;
+	profiler->num_regions = num_regions;
+
+	if (timer_hz) {
+		if (profiler_timer_in_use || timer_hz > 1000000) {
+			FATAL_ERROR("Cannot use the profiler timer at %d Hz", timer_hz);
+		}
+
+		struct sigaction action;
+		memset(&action, 0, sizeof(action));
+		action.sa_handler = profiler_timer_handler;
+		action.sa_flags = SA_RESTART;
+		sigemptyset(&action.sa_mask);
+		if (sigaction(SIGPROF, &action, &profiler->old_action)) {
+			FATAL_ERROR("Failed to install profiler timer handler");
+		}
+
+		profiler_timer_fired = 0;
+		profiler_timer_in_use = true;
+		profiler->timer = true;
+		profiler_set_timer(timer_hz);
+	}
+
+	return profiler;
+}
+
+void profiler_destroy(profiler_t* profiler) {
+	if (profiler->timer) {
+		profiler_set_timer(0);
+		sigaction(SIGPROF, &profiler->old_action, NULL);
+		profiler_timer_in_use = false;
+	}
+
+	for (uint32_t i = 0; i < PROFILER_NUM_PAGES; i++) {
+		free(profiler->pages[i]);
+	}
+	free(profiler);
+}
+
+void profiler_sample(profiler_t* profiler, uint32_t addr) {
+	bool due = false;
+	if (profiler->sample_every && !--profiler->countdown) {
+		profiler->countdown = profiler->sample_every;
+		due = true;
+	}
+
+	if (profiler->timer && profiler_timer_fired) {
+		profiler_timer_fired = 0;
+		due = true;
+	}
+
+	if (__builtin_expect(!due, true)) {
+		return;
+	}
+
+	addr &= (1 << PROFILER_ADDR_BITS) - 1;
+	uint32_t** page = &profiler->pages[addr >> PROFILER_PAGE_BITS];
+	if (!*page) {
+		*page = zalloc(sizeof(uint32_t) * PROFILER_PAGE_SIZE);
+	}
+
+	(*page)[addr & (PROFILER_PAGE_SIZE - 1)]++;
+	profiler->samples++;
+}
+
+static const char* profiler_region_name(profiler_t* profiler, uint32_t addr) {
+	for (uint32_t i = 0; i < profiler->num_regions; i++) {
+		if (addr >= profiler->regions[i].start && addr < profiler->regions[i].end) {
+			return profiler->regions[i].name;
+		}
+	}
+
+	return "other";
+}
+
+static int profiler_compare_entries(const void* a, const void* b) {
+	const profiler_entry_t* entry_a = a;
+	const profiler_entry_t* entry_b = b;
+	if (entry_a->count != entry_b->count) {
+		return entry_a->count > entry_b->count ? -1 : 1;
+	}
+
+	return entry_a->addr < entry_b->addr ? -1 : entry_a->addr > entry_b->addr;
+}
+
+void profiler_write(profiler_t* profiler, const char* report_path, const char* collapsed_path) {
+	uint32_t num_entries = 0;
+	for (uint32_t i = 0; i < PROFILER_NUM_PAGES; i++) {
+		if (profiler->pages[i]) {
+			for (uint32_t j = 0; j < PROFILER_PAGE_SIZE; j++) {
+				num_entries += profiler->pages[i][j] != 0;
+			}
+		}
+	}
+
+	profiler_entry_t* entries = salloc(sizeof(profiler_entry_t) * (num_entries ? num_entries : 1));
+	uint32_t n = 0;
+	for (uint32_t i = 0; i < PROFILER_NUM_PAGES; i++) {
+		if (profiler->pages[i]) {
+			for (uint32_t j = 0; j < PROFILER_PAGE_SIZE; j++) {
+				if (profiler->pages[i][j]) {
+					entries[n].addr = (i << PROFILER_PAGE_BITS) | j;
+					entries[n].count = profiler->pages[i][j];
+					n++;
+				}
+			}
+		}
+	}
+
+	// collapsed stacks are written in address order, the report in hit order
+	FILE* f = fopen(collapsed_path, "w");
+	if (!f) {
+		FATAL_ERROR("Could not open profiler output %s", collapsed_path);
+	}
+
+	for (uint32_t i = 0; i < num_entries; i++) {
+		fprintf(f, "%s;0x%06X;0x%06X %u\n", profiler_region_name(profiler, entries[i].addr),
+			entries[i].addr & ~(PROFILER_PAGE_SIZE - 1), entries[i].addr, entries[i].count);
+	}
+
+	if (fclose(f)) {
+		FATAL_ERROR("Failed to write profiler output %s", collapsed_path);
+	}
+
+	qsort(entries, num_entries, sizeof(profiler_entry_t), profiler_compare_entries);
+
+	f = fopen(report_path, "w");
+	if (!f) {
+		FATAL_ERROR("Could not open profiler output %s", report_path);
+	}
+
+	fprintf(f, "%ld samples over %d PCs\n\n", profiler->samples, num_entries);
+	fprintf(f, "PC        count       %%        region\n");
+	for (uint32_t i = 0; i < num_entries; i++) {
+		fprintf(f, "0x%06X  %-10u  %6.2f%%  %s\n", entries[i].addr, entries[i].count,
+			entries[i].count * 100.0 / profiler->samples, profiler_region_name(profiler, entries[i].addr));
+	}
+
+	if (fclose(f)) {
+		FATAL_ERROR("Failed to write profiler output %s", report_path);
+	}
+
+	free(entries);
+}
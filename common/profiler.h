@@ -0,0 +1,31 @@
+#ifndef _PROFILER_H_
+#define _PROFILER_H_
+
+#include <stdint.h>
+#include <stdbool.h>
+
+// sampling histogram of guest PCs (24-bit), fed from an exec callback
+// samples are taken every Nth call, and/or on the call after each tick of a process CPU time timer
+
+typedef struct {
+	uint32_t start;
+	uint32_t end; // exclusive
+	const char* name;
+} profiler_region_t;
+
+struct profiler_t;
+typedef struct profiler_t profiler_t;
+
+// sample_every and timer_hz can each be 0 to disable that kind of sampling, only one profiler may use the timer at a time
+// regions are used to label addresses in the output, and must outlive the profiler
+profiler_t* profiler_create(uint32_t sample_every, uint32_t timer_hz, const profiler_region_t* regions, uint32_t num_regions);
+void profiler_destroy(profiler_t* profiler);
+
+// call for every executed instruction, records addr if a sample is due
+void profiler_sample(profiler_t* profiler, uint32_t addr);
+
+// writes a report sorted by hits (PC, count, percentage, region) and a collapsed stack file for flamegraph.pl
+// there are no real call stacks, so stacks are region;256 byte page;PC
+void profiler_write(profiler_t* profiler, const char* report_path, const char* collapsed_path);
+
+#endif
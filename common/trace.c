@@ -0,0 +1,140 @@
+#ifdef SLIMHAWK_TRACE
+
+#define _POSIX_C_SOURCE 200809L
+#include <stdatomic.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <time.h>
+
+#include "alloc.h"
+#include "fatal_error.h"
+#include "trace.h"
+
+#define TRACE_CHUNK_EVENTS 65536
+#define TRACE_MAX_CHUNKS 64 // per thread, later events are dropped (and counted)
+
+typedef struct {
+	const char* name;
+	uint64_t start;
+	uint64_t duration;
+} trace_event_t;
+
+typedef struct trace_chunk_t {
+	trace_event_t events[TRACE_CHUNK_EVENTS];
+	struct trace_chunk_t* next;
+} trace_chunk_t;
+
+typedef struct trace_buffer_t {
+	struct trace_buffer_t* next;
+	trace_chunk_t* head;
+	trace_chunk_t* tail;
+	uint32_t tail_count;
+	uint32_t num_chunks;
+	uint64_t dropped;
+	uint32_t tid;
+	const char* name;
+} trace_buffer_t;
+
+static _Atomic(trace_buffer_t*) trace_buffers;
+static atomic_uint trace_next_tid;
+static _Thread_local trace_buffer_t* trace_buffer;
+
+uint64_t trace_now(void) {
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+}
+
+static trace_buffer_t* trace_get_buffer(void) {
+	if (__builtin_expect(!trace_buffer, false)) {
+		trace_buffer_t* buffer = zalloc(sizeof(trace_buffer_t));
+		buffer->tid = atomic_fetch_add(&trace_next_tid, 1) + 1;
+		buffer->head = buffer->tail = zalloc(sizeof(trace_chunk_t));
+		buffer->num_chunks = 1;
+
+		// lock-free push onto the list of buffers, this only happens once per thread
+		buffer->next = atomic_load(&trace_buffers);
+		while (!atomic_compare_exchange_weak(&trace_buffers, &buffer->next, buffer));
+		trace_buffer = buffer;
+	}
+
+	return trace_buffer;
+}
+
+void trace_event(const char* name, uint64_t start) {
+	uint64_t end = trace_now();
+	trace_buffer_t* buffer = trace_get_buffer();
+	if (buffer->tail_count == TRACE_CHUNK_EVENTS) {
+		if (buffer->num_chunks == TRACE_MAX_CHUNKS) {
+			buffer->dropped++;
+			return;
+		}
+
+		buffer->tail->next = zalloc(sizeof(trace_chunk_t));
+		buffer->tail = buffer->tail->next;
+		buffer->tail_count = 0;
+		buffer->num_chunks++;
+	}
+
+	trace_event_t* event = &buffer->tail->events[buffer->tail_count++];
+	event->name = name;
+	event->start = start;
+	event->duration = end - start;
+}
+
+void trace_set_thread_name(const char* name) {
+	trace_get_buffer()->name = name;
+}
+
+void trace_write(const char* path) {
+	trace_buffer_t* buffers = atomic_load(&trace_buffers);
+
+	// timestamps are relative to the earliest start, which isn't always the first event recorded
+	// (events are recorded when they end, so an enclosing event comes after the ones nested in it)
+	uint64_t epoch = UINT64_MAX;
+	for (trace_buffer_t* buffer = buffers; buffer; buffer = buffer->next) {
+		for (trace_chunk_t* chunk = buffer->head; chunk; chunk = chunk->next) {
+			uint32_t count = chunk == buffer->tail ? buffer->tail_count : TRACE_CHUNK_EVENTS;
+			for (uint32_t i = 0; i < count; i++) {
+				if (chunk->events[i].start < epoch) {
+					epoch = chunk->events[i].start;
+				}
+			}
+		}
+	}
+
+	FILE* f = fopen(path, "w");
+	if (!f) {
+		FATAL_ERROR("Could not open trace file %s", path);
+	}
+
+	fprintf(f, "{\"traceEvents\":[\n");
+	bool first = true;
+	for (trace_buffer_t* buffer = buffers; buffer; buffer = buffer->next) {
+		if (buffer->name) {
+			fprintf(f, "%s{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":1,\"tid\":%u,\"args\":{\"name\":\"%s\"}}", first ? "" : ",\n", buffer->tid, buffer->name);
+			first = false;
+		}
+
+		for (trace_chunk_t* chunk = buffer->head; chunk; chunk = chunk->next) {
+			uint32_t count = chunk == buffer->tail ? buffer->tail_count : TRACE_CHUNK_EVENTS;
+			for (uint32_t i = 0; i < count; i++) {
+				trace_event_t* event = &chunk->events[i];
+				fprintf(f, "%s{\"name\":\"%s\",\"ph\":\"X\",\"pid\":1,\"tid\":%u,\"ts\":%.3f,\"dur\":%.3f}", first ? "" : ",\n",
+					event->name, buffer->tid, (event->start - epoch) / 1000.0, event->duration / 1000.0);
+				first = false;
+			}
+		}
+
+		if (buffer->dropped) {
+			fprintf(stderr, "Trace buffer for thread %u was full, dropped %ld events\n", buffer->tid, buffer->dropped);
+		}
+	}
+
+	fprintf(f, "\n]}\n");
+	if (fclose(f)) {
+		FATAL_ERROR("Failed to write trace file %s", path);
+	}
+}
+
+#endif
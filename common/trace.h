@@ -0,0 +1,35 @@
+#ifndef _TRACE_H_
+#define _TRACE_H_
+
+#include <stdint.h>
+
+// timeline tracing, written out in Chrome trace format (load it in chrome://tracing or ui.perfetto.dev)
+// only compiled in with SLIMHAWK_TRACE, otherwise every macro here expands to nothing
+
+#ifdef SLIMHAWK_TRACE
+
+#define TRACE_FILE "trace.json"
+
+// events are appended to a buffer owned by the calling thread, so recording never takes a lock
+// name must be a string literal (or otherwise live until the trace is written)
+uint64_t trace_now(void);
+void trace_event(const char* name, uint64_t start);
+void trace_set_thread_name(const char* name);
+// only call once every traced thread is done
+void trace_write(const char* path);
+
+#define TRACE_BEGIN(VAR) uint64_t VAR = trace_now()
+#define TRACE_END(NAME, VAR) trace_event(NAME, VAR)
+#define TRACE_THREAD_NAME(NAME) trace_set_thread_name(NAME)
+#define TRACE_WRITE() trace_write(TRACE_FILE)
+
+#else
+
+#define TRACE_BEGIN(VAR)
+#define TRACE_END(NAME, VAR)
+#define TRACE_THREAD_NAME(NAME)
+#define TRACE_WRITE()
+
+#endif
+
+#endif
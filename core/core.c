@@ -15,7 +15,7 @@ static void add_core_file(core_file_t*** files, uint32_t* num_files, const char*
 static void add_disc_file(disc_impl_t*** discs, uint32_t* num_discs, const char* path) {
 	++(*num_discs);
 	*discs = ralloc(*discs, sizeof(disc_impl_t*) * (*num_discs));
-	(*discs)[*num_discs - 1] = disc_impl_create(path);
+	(*discs)[*num_discs - 1] = disc_impl_create(path, NULL);
 }
 
 core_t* core_parse_cli(int argc, char* argv[]) {
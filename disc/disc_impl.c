@@ -1,73 +1,469 @@
+#include <threads.h>
+
 #include "alloc.h"
 #include "fatal_error.h"
+#include "min_max.h"
 #include "disc_impl.h"
 
 // mednadisc imports
-void* mednadisc_LoadCD(const char* filename);
-void mednadisc_ReadTOC(void* disc, disc_impl_toc_t* toc, disc_impl_track_t* tracks);	
+void* mednadisc_LoadCDEx(const char* filename, bool memcache);
+void mednadisc_Preload(void* disc);
+void mednadisc_ReadTOC(void* disc, disc_impl_toc_t* toc, disc_impl_track_t* tracks);
 int32_t mednadisc_ReadSector(void* disc, int32_t lba, void* buf_2448);
+const void* mednadisc_MapSector(void* disc, int32_t lba);
+int32_t mednadisc_ReadSector2048(void* disc, int32_t lba, void* buf_2048);
+void mednadisc_SubPWDeinterleave(const uint8_t* in96, uint8_t* out96);
+int32_t mednadisc_ConvertHCD(const char* src_filename, const char* dst_filename, int32_t codec);
 void mednadisc_CloseCD(void* disc);
 
+#define DISC_IMPL_SECTOR_SIZE 2448
+#define DISC_IMPL_PREGAP 150 // LBAs from -150 up to the leadout can be cached
+#define DISC_IMPL_NO_SLOT UINT32_MAX
+#define DISC_IMPL_STREAM_THRESHOLD 4 // sequential reads in a row before reading ahead
+#define DISC_IMPL_MIN_READAHEAD 4 // the window starts here, and doubles each time it's refilled
+
+typedef struct {
+	int32_t lba;
+	uint32_t prev; // towards the most recently used
+	uint32_t next;
+	bool readahead; // read ahead, and not requested since
+} disc_impl_slot_t;
+
+// sectors from start onwards, filled in order by the worker
+// the sector the worker is reading (if any) is always start + count, so consuming from the front doesn't disturb it
+typedef struct {
+	uint8_t* sectors;
+	uint32_t size;
+	uint32_t head;
+	uint32_t count;
+	int32_t start;
+	uint32_t generation; // bumped when the ring is moved, so an in flight read knows to drop its sector
+	uint64_t prefetched;
+	thrd_t worker;
+	mtx_t lock;
+	cnd_t work; // signalled when there's room, or the ring moved
+	cnd_t filled; // signalled when a sector was added
+	bool worker_waiting; // signals are only sent to a thread which is waiting on them
+	bool reader_waiting;
+	bool exit;
+} disc_impl_ring_t;
+
 struct disc_impl_t {
 	void* ctx;
+	mtx_t ctx_lock; // mednadisc isn't thread safe, only needed with a prefetch worker
+	thrd_t preloader;
+	bool preloading; // the preloader needs joining
 	disc_impl_toc_t toc;
-	uint8_t buf_2442[2442];
+	disc_impl_options_t options;
+	int32_t end_lba; // leadout
+	uint32_t* slot_of_lba; // indexed by LBA + pregap
+	disc_impl_slot_t* slots;
+	uint8_t* sectors;
+	uint32_t num_slots_used;
+	uint32_t head; // most recently used
+	uint32_t tail; // least recently used
+	int32_t next_lba; // continues the current stream
+	uint32_t streak;
+	uint32_t window;
+	int32_t readahead_end; // first LBA past what has been read ahead
+	disc_impl_ring_t* ring;
+	disc_impl_stats_t stats;
+	uint8_t scratch[DISC_IMPL_SECTOR_SIZE];
 };
 
-disc_impl_t* disc_impl_create(const char* filename) {
+static void disc_impl_read_raw(disc_impl_t* impl, int32_t lba, uint8_t* buffer) {
+	memset(buffer, 0, DISC_IMPL_SECTOR_SIZE);
+	if (impl->ring) {
+		mtx_lock(&impl->ctx_lock);
+		mednadisc_ReadSector(impl->ctx, lba, buffer);
+		mtx_unlock(&impl->ctx_lock);
+	} else {
+		mednadisc_ReadSector(impl->ctx, lba, buffer);
+	}
+}
+
+static int disc_impl_prefetch_worker_thread(void* arg) {
+	disc_impl_t* impl = arg;
+	disc_impl_ring_t* ring = impl->ring;
+	mtx_lock(&ring->lock);
+
+	while (true) {
+		while (!ring->exit && (ring->count == ring->size || ring->start + (int32_t)ring->count >= impl->end_lba)) {
+			ring->worker_waiting = true;
+			cnd_wait(&ring->work, &ring->lock);
+			ring->worker_waiting = false;
+		}
+
+		if (ring->exit) {
+			break;
+		}
+
+		// nothing else touches this slot until it's counted, so it can be read into without holding the lock
+		int32_t lba = ring->start + ring->count;
+		uint32_t generation = ring->generation;
+		uint8_t* sector = &ring->sectors[(size_t)((ring->head + ring->count) % ring->size) * DISC_IMPL_SECTOR_SIZE];
+		mtx_unlock(&ring->lock);
+		disc_impl_read_raw(impl, lba, sector);
+		mtx_lock(&ring->lock);
+
+		if (generation == ring->generation) {
+			ring->count++;
+			ring->prefetched++;
+			if (ring->reader_waiting) {
+				cnd_signal(&ring->filled);
+			}
+		}
+	}
+
+	mtx_unlock(&ring->lock);
+	return 0;
+}
+
+static void disc_impl_start_prefetch(disc_impl_t* impl) {
+	disc_impl_ring_t* ring = zalloc(sizeof(disc_impl_ring_t));
+	ring->sectors = salloc((size_t)DISC_IMPL_SECTOR_SIZE * impl->options.prefetch_sectors);
+	ring->size = impl->options.prefetch_sectors;
+	ring->start = impl->end_lba; // idle until the first read
+	mtx_init(&ring->lock, mtx_plain);
+	cnd_init(&ring->work);
+	cnd_init(&ring->filled);
+	mtx_init(&impl->ctx_lock, mtx_plain);
+	impl->ring = ring;
+	thrd_create(&ring->worker, disc_impl_prefetch_worker_thread, impl);
+}
+
+static void disc_impl_stop_prefetch(disc_impl_t* impl) {
+	disc_impl_ring_t* ring = impl->ring;
+	mtx_lock(&ring->lock);
+	ring->exit = true;
+	cnd_broadcast(&ring->work);
+	mtx_unlock(&ring->lock);
+	thrd_join(ring->worker, NULL);
+
+	mtx_destroy(&ring->lock);
+	cnd_destroy(&ring->work);
+	cnd_destroy(&ring->filled);
+	mtx_destroy(&impl->ctx_lock);
+	free(ring->sectors);
+	free(ring);
+}
+
+// takes the sector from the ring if it's there (or about to be), otherwise moves the ring to just past it and reads it here
+static void disc_impl_read_prefetched(disc_impl_t* impl, int32_t lba, uint8_t* buffer) {
+	disc_impl_ring_t* ring = impl->ring;
+	mtx_lock(&ring->lock);
+
+	if (lba >= ring->start && lba <= ring->start + (int32_t)ring->count) {
+		// drop everything before it, this keeps the worker reading from the same place
+		uint32_t skip = lba - ring->start;
+		ring->head = (ring->head + skip) % ring->size;
+		ring->count -= skip;
+		ring->start = lba;
+
+		// the worker is already on it
+		if (!ring->count) {
+			impl->stats.prefetch_waits++;
+			if (ring->worker_waiting) {
+				cnd_signal(&ring->work);
+			}
+			ring->reader_waiting = true;
+			while (!ring->count) {
+				cnd_wait(&ring->filled, &ring->lock);
+			}
+			ring->reader_waiting = false;
+		}
+
+		memcpy(buffer, &ring->sectors[(size_t)ring->head * DISC_IMPL_SECTOR_SIZE], DISC_IMPL_SECTOR_SIZE);
+		ring->head = (ring->head + 1) % ring->size;
+		ring->count--;
+		ring->start++;
+		impl->stats.prefetch_hits++;
+		if (ring->worker_waiting) {
+			cnd_signal(&ring->work);
+		}
+		mtx_unlock(&ring->lock);
+		return;
+	}
+
+	ring->generation++;
+	ring->head = 0;
+	ring->count = 0;
+	ring->start = lba + 1;
+	if (ring->worker_waiting) {
+		cnd_signal(&ring->work);
+	}
+	mtx_unlock(&ring->lock);
+
+	disc_impl_read_raw(impl, lba, buffer);
+}
+
+static void disc_impl_read_sector(disc_impl_t* impl, int32_t lba, uint8_t* buffer) {
+	if (impl->ring) {
+		disc_impl_read_prefetched(impl, lba, buffer);
+	} else {
+		disc_impl_read_raw(impl, lba, buffer);
+	}
+}
+
+static int disc_impl_preload_thread(void* arg) {
+	disc_impl_t* impl = arg;
+	mednadisc_Preload(impl->ctx);
+	return 0;
+}
+
+disc_impl_t* disc_impl_create(const char* filename, const disc_impl_options_t* options) {
 	disc_impl_t* impl = zalloc(sizeof(disc_impl_t));
-	impl->ctx = mednadisc_LoadCD(filename);
+	if (options) {
+		impl->options = *options;
+	} else {
+		impl->options.cache_sectors = DISC_IMPL_DEFAULT_CACHE_SECTORS;
+		impl->options.max_readahead = DISC_IMPL_DEFAULT_MAX_READAHEAD;
+		impl->options.prefetch_sectors = DISC_IMPL_DEFAULT_PREFETCH_SECTORS;
+		impl->options.memcache = DISC_IMPL_DEFAULT_MEMCACHE;
+		impl->options.preload = DISC_IMPL_DEFAULT_PRELOAD;
+	}
+
+	impl->ctx = mednadisc_LoadCDEx(filename, impl->options.memcache);
 	if (!impl->ctx) {
 		FATAL_ERROR("mednadisc rejected %s!", filename);
 	}
 	mednadisc_ReadTOC(impl->ctx, &impl->toc, impl->toc.tracks);
+	impl->end_lba = impl->toc.tracks[100].lba;
+
+	// 2048 and 2352 byte reads of a mapped image never go through the ring, so by default only start a worker for images that need building
+	if (!options && mednadisc_MapSector(impl->ctx, impl->toc.tracks[impl->toc.first_track].lba)) {
+		impl->options.prefetch_sectors = 0;
+	}
+
+	if (impl->options.preload == DISC_IMPL_PRELOAD_BLOCKING) {
+		mednadisc_Preload(impl->ctx);
+	} else if (impl->options.preload == DISC_IMPL_PRELOAD_THREAD) {
+		thrd_create(&impl->preloader, disc_impl_preload_thread, impl);
+		impl->preloading = true;
+	}
+
+	// readahead can't be allowed to evict the sector it's reading ahead of, and the worker does it instead if there is one
+	impl->options.max_readahead = MIN(impl->options.max_readahead, impl->options.cache_sectors / 2);
+	if (impl->options.prefetch_sectors) {
+		impl->options.max_readahead = 0;
+	}
+
+	if (impl->options.cache_sectors) {
+		uint32_t num_lbas = impl->end_lba + DISC_IMPL_PREGAP;
+		impl->slot_of_lba = salloc(sizeof(uint32_t) * num_lbas);
+		memset(impl->slot_of_lba, 0xFF, sizeof(uint32_t) * num_lbas);
+		impl->slots = salloc(sizeof(disc_impl_slot_t) * impl->options.cache_sectors);
+		impl->sectors = salloc((size_t)DISC_IMPL_SECTOR_SIZE * impl->options.cache_sectors);
+		impl->head = impl->tail = DISC_IMPL_NO_SLOT;
+	}
+
+	if (impl->options.prefetch_sectors) {
+		disc_impl_start_prefetch(impl);
+	}
+
+	impl->next_lba = INT32_MIN;
 	return impl;
 }
 
 void disc_impl_destroy(disc_impl_t* impl) {
+	if (impl->preloading) {
+		thrd_join(impl->preloader, NULL);
+	}
+	if (impl->ring) {
+		disc_impl_stop_prefetch(impl);
+	}
 	mednadisc_CloseCD(impl->ctx);
+	free(impl->slot_of_lba);
+	free(impl->slots);
+	free(impl->sectors);
 	free(impl);
 }
 
-static void disc_impl_deinterleave(uint8_t* buffer) {
-	uint8_t out_buf[96];
-	memset(out_buf, 0, sizeof(out_buf));
+static void disc_impl_unlink(disc_impl_t* impl, uint32_t slot) {
+	disc_impl_slot_t* entry = &impl->slots[slot];
+	if (entry->prev != DISC_IMPL_NO_SLOT) {
+		impl->slots[entry->prev].next = entry->next;
+	} else {
+		impl->head = entry->next;
+	}
+
+	if (entry->next != DISC_IMPL_NO_SLOT) {
+		impl->slots[entry->next].prev = entry->prev;
+	} else {
+		impl->tail = entry->prev;
+	}
+}
+
+static void disc_impl_push_front(disc_impl_t* impl, uint32_t slot) {
+	disc_impl_slot_t* entry = &impl->slots[slot];
+	entry->prev = DISC_IMPL_NO_SLOT;
+	entry->next = impl->head;
+	if (impl->head != DISC_IMPL_NO_SLOT) {
+		impl->slots[impl->head].prev = slot;
+	} else {
+		impl->tail = slot;
+	}
+	impl->head = slot;
+}
+
+// builds the sector into a free slot (or the least recently used one) and makes it the most recently used
+static uint32_t disc_impl_fill(disc_impl_t* impl, int32_t lba, bool readahead) {
+	uint32_t slot;
+	if (impl->num_slots_used < impl->options.cache_sectors) {
+		slot = impl->num_slots_used++;
+	} else {
+		slot = impl->tail;
+		disc_impl_unlink(impl, slot);
+		impl->slot_of_lba[impl->slots[slot].lba + DISC_IMPL_PREGAP] = DISC_IMPL_NO_SLOT;
+		impl->stats.evictions++;
+	}
+
+	disc_impl_read_sector(impl, lba, &impl->sectors[(size_t)slot * DISC_IMPL_SECTOR_SIZE]);
+	impl->slots[slot].lba = lba;
+	impl->slots[slot].readahead = readahead;
+	impl->slot_of_lba[lba + DISC_IMPL_PREGAP] = slot;
+	disc_impl_push_front(impl, slot);
+	return slot;
+}
+
+// once a stream is detected, sectors are read ahead in batches whenever it gets within half a window of the end
+// each batch doubles the window, so long streams read further ahead while short bursts don't waste much
+static void disc_impl_readahead(disc_impl_t* impl, int32_t lba) {
+	if (lba == impl->next_lba) {
+		impl->streak++;
+	} else {
+		impl->streak = 0;
+		impl->window = 0;
+		impl->readahead_end = lba + 1;
+	}
+	impl->next_lba = lba + 1;
+
+	if (!impl->options.max_readahead || impl->streak < DISC_IMPL_STREAM_THRESHOLD) {
+		return;
+	}
 
-	for (uint32_t ch = 0; ch < 8; ch++) {
-		for (uint32_t i = 0; i < 96; i++) {
-			out_buf[(ch * 12) + (i >> 3)] |= (((buffer[i] >> (7 - ch)) & 1) << (7 - (i & 7)));
+	if (lba + (int32_t)impl->window / 2 < impl->readahead_end) {
+		return;
+	}
+
+	uint32_t window = impl->window ? impl->window * 2 : DISC_IMPL_MIN_READAHEAD;
+	impl->window = MIN(window, impl->options.max_readahead);
+	int32_t start = MAX(impl->readahead_end, lba + 1);
+	int32_t end = MIN(lba + 1 + (int32_t)impl->window, impl->end_lba);
+	for (int32_t i = start; i < end; i++) {
+		if (impl->slot_of_lba[i + DISC_IMPL_PREGAP] == DISC_IMPL_NO_SLOT) {
+			disc_impl_fill(impl, i, true);
+			impl->stats.readahead++;
 		}
 	}
+	impl->readahead_end = MAX(impl->readahead_end, end);
+}
+
+// returns the raw sector with interleaved subchannel, which is only valid until the next read
+static const uint8_t* disc_impl_get_sector(disc_impl_t* impl, int32_t lba) {
+	impl->stats.reads++;
+	if (lba < -DISC_IMPL_PREGAP || lba >= impl->end_lba) {
+		impl->stats.misses++;
+		disc_impl_read_raw(impl, lba, impl->scratch);
+		return impl->scratch;
+	}
+
+	if (!impl->options.cache_sectors) {
+		impl->stats.misses++;
+		disc_impl_read_sector(impl, lba, impl->scratch);
+		return impl->scratch;
+	}
+
+	uint32_t slot = impl->slot_of_lba[lba + DISC_IMPL_PREGAP];
+	if (slot != DISC_IMPL_NO_SLOT) {
+		impl->stats.hits++;
+		if (impl->slots[slot].readahead) {
+			impl->stats.readahead_hits++;
+			impl->slots[slot].readahead = false;
+		}
+		disc_impl_unlink(impl, slot);
+		disc_impl_push_front(impl, slot);
+	} else {
+		impl->stats.misses++;
+		slot = disc_impl_fill(impl, lba, false);
+	}
 
+	// readahead only ever evicts from the back half of the cache, so this stays put
+	disc_impl_readahead(impl, lba);
+	return &impl->sectors[(size_t)slot * DISC_IMPL_SECTOR_SIZE];
+}
+
+static void disc_impl_deinterleave(uint8_t* buffer) {
+	uint8_t out_buf[96];
+	mednadisc_SubPWDeinterleave(buffer, out_buf);
 	memcpy(buffer, out_buf, sizeof(out_buf));
 }
 
 void disc_impl_read_lba_2448(disc_impl_t* impl, int32_t lba, void* buffer, bool deinterlave) {
-	memset(buffer, 0, 2352);
-	mednadisc_ReadSector(impl->ctx, lba, buffer);
+	memcpy(buffer, disc_impl_get_sector(impl, lba), DISC_IMPL_SECTOR_SIZE);
 	if (deinterlave) {
 		disc_impl_deinterleave((uint8_t*)buffer + 2352);
 	}
 }
 
+// sectors stored raw in a mapped image don't need building (the mapping is immutable, so no lock is needed)
+// this only has the main channel, so 2448 byte reads still go through the cache
+static const uint8_t* disc_impl_map_sector(disc_impl_t* impl, int32_t lba) {
+	const uint8_t* sector = mednadisc_MapSector(impl->ctx, lba);
+	if (sector) {
+		impl->stats.reads++;
+		impl->stats.mapped++;
+	}
+
+	return sector;
+}
+
 void disc_impl_read_lba_2352(disc_impl_t* impl, int32_t lba, void* buffer) {
-	memset(impl->buf_2442, 0, 2352);
-	mednadisc_ReadSector(impl->ctx, lba, impl->buf_2442);
-	memcpy(buffer, impl->buf_2442, 2352);
+	const uint8_t* sector = disc_impl_map_sector(impl, lba);
+	if (!sector) {
+		sector = disc_impl_get_sector(impl, lba);
+	}
+
+	memcpy(buffer, sector, 2352);
+}
+
+// reads the user data without building the whole sector, false if the sector needs building
+static bool disc_impl_read_cooked(disc_impl_t* impl, int32_t lba, void* buffer) {
+	if (impl->ring) {
+		mtx_lock(&impl->ctx_lock);
+	}
+
+	bool read = mednadisc_ReadSector2048(impl->ctx, lba, buffer);
+
+	if (impl->ring) {
+		mtx_unlock(&impl->ctx_lock);
+	}
+
+	if (read) {
+		impl->stats.reads++;
+		impl->stats.cooked++;
+	}
+
+	return read;
 }
 
 void disc_impl_read_lba_2048(disc_impl_t* impl, int32_t lba, void* buffer) {
-	memset(impl->buf_2442, 0, 2072);
-	mednadisc_ReadSector(impl->ctx, lba, impl->buf_2442);
+	const uint8_t* sector = disc_impl_map_sector(impl, lba);
+	if (!sector) {
+		if (disc_impl_read_cooked(impl, lba, buffer)) {
+			return;
+		}
+		sector = disc_impl_get_sector(impl, lba);
+	}
 
-	if (impl->buf_2442[15] == 1) {
-		memcpy(buffer, &impl->buf_2442[16], 2048);
-	} else if (impl->buf_2442[15] == 2) {
-		if (impl->buf_2442[18] >> 5 & 1) {
+	if (sector[15] == 1) {
+		memcpy(buffer, &sector[16], 2048);
+	} else if (sector[15] == 2) {
+		if (sector[18] >> 5 & 1) {
 			memset(buffer, 0, 2048);
 			return;
 		}
-		memcpy(buffer, &impl->buf_2442[24], 2048);
+		memcpy(buffer, &sector[24], 2048);
 	} else {
 		memset(buffer, 0, 2048);
 	}
@@ -76,3 +472,29 @@ void disc_impl_read_lba_2048(disc_impl_t* impl, int32_t lba, void* buffer) {
 disc_impl_toc_t* disc_impl_get_toc(disc_impl_t* impl) {
 	return &impl->toc;
 }
+
+void disc_impl_get_stats(disc_impl_t* impl, disc_impl_stats_t* stats) {
+	*stats = impl->stats;
+	if (impl->ring) {
+		mtx_lock(&impl->ring->lock);
+		stats->prefetched = impl->ring->prefetched;
+		mtx_unlock(&impl->ring->lock);
+	}
+}
+
+void disc_impl_print_stats(disc_impl_t* impl) {
+	disc_impl_stats_t stats;
+	disc_impl_get_stats(impl, &stats);
+	printf("Disc cache: %ld / %ld hits (%.1f%%), %ld read ahead (%ld used), %ld evictions, %ld mapped, %ld cooked\n",
+		stats.hits, stats.reads, stats.reads ? stats.hits * 100.0 / stats.reads : 0.0,
+		stats.readahead, stats.readahead_hits, stats.evictions, stats.mapped, stats.cooked);
+	if (impl->ring) {
+		printf("Disc prefetch: %ld / %ld misses from the ring, %ld waited, %ld prefetched\n",
+			stats.prefetch_hits, stats.misses, stats.prefetch_waits, stats.prefetched);
+	}
+	fflush(stdout);
+}
+
+bool disc_impl_convert(const char* src_filename, const char* dst_filename, disc_impl_codec_t codec) {
+	return mednadisc_ConvertHCD(src_filename, dst_filename, codec);
+}
@@ -19,14 +19,64 @@ typedef struct {
 	disc_impl_track_t tracks[101];
 } disc_impl_toc_t;
 
+#define DISC_IMPL_DEFAULT_CACHE_SECTORS 1024
+#define DISC_IMPL_DEFAULT_MAX_READAHEAD 32
+#define DISC_IMPL_DEFAULT_PREFETCH_SECTORS 64
+#define DISC_IMPL_DEFAULT_MEMCACHE false
+#define DISC_IMPL_DEFAULT_PRELOAD DISC_IMPL_PRELOAD_THREAD
+
+typedef enum {
+	DISC_IMPL_PRELOAD_NONE,
+	DISC_IMPL_PRELOAD_BLOCKING, // done before disc_impl_create returns
+	DISC_IMPL_PRELOAD_THREAD, // done on a background thread, so reads can start straight away
+} disc_impl_preload_t;
+
+// hunk compressors for disc_impl_convert
+// .hcd images save space and copy time, not read time: decompressing a hunk costs around 17us a sector with deflate and 85us with LZMA,
+// against under 1us for a raw image read
+// every read size goes through the cache and the prefetch worker, so with a spare core the worker can decompress ahead of a sequential
+// stream, but on a single core that doesn't hide the cost, and random reads pay it in full
+typedef enum {
+	DISC_IMPL_CODEC_DEFLATE = 1, // faster to decompress
+	DISC_IMPL_CODEC_LZMA = 2, // about a tenth smaller, but 5 times slower to decompress
+} disc_impl_codec_t;
+
+#define DISC_IMPL_DEFAULT_CODEC DISC_IMPL_CODEC_DEFLATE
+
+typedef struct {
+	uint32_t cache_sectors; // fully built sectors kept in an LRU, 0 disables the cache (and readahead)
+	uint32_t max_readahead; // sectors read ahead of a sequential stream on the reading thread, at most half the cache, 0 disables readahead
+	uint32_t prefetch_sectors; // ring filled ahead of the last requested sector by a worker thread, which replaces readahead, 0 for no worker
+	// only 2448 byte reads of a mapped image use the ring, so the defaults leave the worker off for those
+	bool memcache; // read the whole image into memory when opened, instead of mapping it
+	disc_impl_preload_t preload; // make the whole image resident (with huge pages where allowed), so reads never wait on storage
+} disc_impl_options_t;
+
+typedef struct {
+	uint64_t reads;
+	uint64_t hits;
+	uint64_t misses; // includes reads outside of the disc, which are never cached
+	uint64_t readahead; // sectors read ahead of being requested
+	uint64_t readahead_hits; // requests for sectors which were read ahead
+	uint64_t evictions;
+	uint64_t mapped; // 2048 and 2352 byte reads served straight from the mapped image, bypassing the cache
+	uint64_t cooked; // 2048 byte reads of just the user data, bypassing the cache
+	uint64_t prefetched; // sectors read by the worker
+	uint64_t prefetch_hits; // misses which were taken from the ring
+	uint64_t prefetch_waits; // misses which had to wait for the worker to finish reading the sector
+} disc_impl_stats_t;
+
 struct disc_impl_t;
 typedef struct disc_impl_t disc_impl_t;
 
-disc_impl_t* disc_impl_create(const char* filename);
+disc_impl_t* disc_impl_create(const char* filename, const disc_impl_options_t* options); // NULL options for the defaults
 void disc_impl_destroy(disc_impl_t* impl);
 void disc_impl_read_lba_2448(disc_impl_t* impl, int32_t lba, void* buffer, bool deinterlave);
 void disc_impl_read_lba_2352(disc_impl_t* impl, int32_t lba, void* buffer);
 void disc_impl_read_lba_2048(disc_impl_t* impl, int32_t lba, void* buffer);
 disc_impl_toc_t* disc_impl_get_toc(disc_impl_t* impl);
+void disc_impl_get_stats(disc_impl_t* impl, disc_impl_stats_t* stats);
+void disc_impl_print_stats(disc_impl_t* impl);
+bool disc_impl_convert(const char* src_filename, const char* dst_filename, disc_impl_codec_t codec); // writes a hunk compressed .hcd image, which opens like any other
 
 #endif
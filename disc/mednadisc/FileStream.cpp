@@ -172,7 +172,7 @@ uint8 *FileStream::map(void) noexcept
   else
   {
    prot |= PROT_WRITE;
-   prot |= MAP_SHARED;
+   flags |= MAP_SHARED;
   }
 
   if(length > SIZE_MAX)
@@ -212,6 +212,30 @@ void FileStream::unmap(void) noexcept
  }
 }
 
+void FileStream::preload(void) noexcept
+{
+ if(!mapping)
+  return;
+
+#ifdef HAVE_MADVISE
+ #ifdef MADV_HUGEPAGE
+ // Only honoured for file mappings on filesystems with large folio support, harmless elsewhere.
+ madvise(mapping, mapping_size, MADV_HUGEPAGE);
+ #endif
+
+ #ifdef MADV_POPULATE_READ
+ if(!madvise(mapping, mapping_size, MADV_POPULATE_READ))
+  return;
+ #endif
+#endif
+
+ // Older kernels, fault every page in by hand.
+ volatile uint8 sink = 0;
+
+ for(uint64 i = 0; i < mapping_size; i += 4096)
+  sink ^= ((volatile uint8*)mapping)[i];
+}
+
 
 uint64 FileStream::read(void *data, uint64 count, bool error_on_eos)
 {
@@ -44,6 +44,7 @@ class FileStream : public Stream
  virtual uint8 *map(void) noexcept override;
  virtual uint64 map_size(void) noexcept override;
  virtual void unmap(void) noexcept override;
+ virtual void preload(void) noexcept override;
 
  virtual uint64 read(void *data, uint64 count, bool error_on_eos = true) override;
  virtual void write(const void *data, uint64 count) override;
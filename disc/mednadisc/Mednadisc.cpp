@@ -6,6 +6,9 @@
 #include "cdrom/CDUtility.h"
 #include "cdrom/cdromif.h"
 #include "cdrom/CDAccess_Image.h"
+#include "cdrom/CDAccess_HCD.h"
+#include "cdrom/dvdisaster.h"
+#include "cdrom/lec.h"
 
 
 class MednaDisc
@@ -19,11 +22,12 @@ public:
 	CDUtility::TOC toc;
 };
 
-EXPORT void* mednadisc_LoadCD(const char* fname)
+//memcache reads every image file into memory up front, rather than mapping them
+EXPORT void* mednadisc_LoadCDEx(const char* fname, bool memcache)
 {
 	CDAccess* disc = NULL;
 	try {
-		disc = CDAccess_Open(fname,false);
+		disc = CDAccess_Open(fname,memcache);
 	}
 	catch(MDFN_Error &) {
 		return NULL;
@@ -68,7 +72,96 @@ EXPORT int32 mednadisc_ReadSector(MednaDisc* md, int lba, void* buf2448)
 	return 1;
 }
 
+//reads just the 2048 bytes of user data (zeroes if the sector has none), without building the rest of the sector
+//returns 0 if the sector has to be read with mednadisc_ReadSector instead
+EXPORT int32 mednadisc_ReadSector2048(MednaDisc* md, int lba, void* buf2048)
+{
+	try
+	{
+		return md->disc->Fast_Read_User_Data((uint8*)buf2048,lba);
+	}
+	catch(MDFN_Error &) {
+		return 0;
+	}
+}
+
+//returns the 2352 bytes of main channel data straight from the mapped image, or NULL if the sector has to be read
+//the pointer stays valid until the disc is closed, and this can be called from any thread
+EXPORT const void* mednadisc_MapSector(MednaDisc* md, int lba)
+{
+	return md->disc->Map_Raw_Sector(lba);
+}
+
+EXPORT void* mednadisc_LoadCD(const char* fname)
+{
+	return mednadisc_LoadCDEx(fname,false);
+}
+
+//faults the whole image in (with huge pages where allowed), this can run on another thread while sectors are read
+EXPORT void mednadisc_Preload(MednaDisc* md)
+{
+	md->disc->Preload();
+}
+
+//writes any image mednadisc can open to a hunk compressed .hcd image, codec 1 is deflate and 2 is LZMA
+//returns 0 if either image couldn't be opened, or the conversion failed
+EXPORT int32 mednadisc_ConvertHCD(const char* src_fname, const char* dst_fname, int32 codec)
+{
+	try
+	{
+		std::unique_ptr<CDAccess> src(CDAccess_Open(src_fname,false));
+		CDAccess_HCD::Convert(src.get(), dst_fname, codec);
+	}
+	catch(MDFN_Error &) {
+		return 0;
+	}
+	return 1;
+}
+
 EXPORT void mednadisc_CloseCD(MednaDisc* md)
 {
 	delete md;
-} 
+}
+
+//sector primitives, exported for the microbenchmarks (and for synthesizing test images)
+EXPORT void mednadisc_EncodeMode1Sector(uint32 aba, uint8* sector2352)
+{
+	CDUtility::encode_mode1_sector(aba, sector2352);
+}
+
+EXPORT uint32 mednadisc_EDC(const uint8* data, int32 len)
+{
+	return EDCCrc32(data, len);
+}
+
+//runs one particular EDC implementation (EDC_IMPL_*), returns 0 if it isn't available on this CPU
+EXPORT int32 mednadisc_EDCImpl(int32 impl, const uint8* data, int32 len, uint32* edc)
+{
+	EDCCrc32Func func = EDCCrc32_Get(impl);
+	if(!func)
+		return 0;
+
+	*edc = func(data, len);
+	return 1;
+}
+
+//computes the P/Q parity of a mode 1 sector with one particular implementation (LEC_PARITY_*), returns 0 if it isn't available on this CPU
+EXPORT int32 mednadisc_PQParityImpl(int32 impl, uint8* sector2352)
+{
+	return lec_calc_PQ_parity(impl, sector2352);
+}
+
+EXPORT int32 mednadisc_CheckAndCorrectSector(uint8* sector2352, bool xa)
+{
+	return CDUtility::edc_lec_check_and_correct(sector2352, xa);
+}
+
+EXPORT void mednadisc_SubPWInterleave(const uint8* in96, uint8* out96)
+{
+	CDUtility::subpw_interleave(in96, out96);
+}
+
+EXPORT void mednadisc_SubPWDeinterleave(const uint8* in96, uint8* out96)
+{
+	CDUtility::subpw_deinterleave(in96, out96);
+}
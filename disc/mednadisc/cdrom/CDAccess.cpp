@@ -19,6 +19,7 @@
 #include "CDAccess.h"
 #include "CDAccess_Image.h"
 #include "CDAccess_CCD.h"
+#include "CDAccess_HCD.h"
 
 using namespace CDUtility;
 
@@ -32,12 +33,31 @@ CDAccess::~CDAccess()
 
 }
 
+int32 CDAccess::User_Data_Offset(const uint8 *header24)
+{
+ switch(header24[12 + 3])
+ {
+  case 0x01:
+	return(16);
+
+  case 0x02:
+	// Form 2 has 2324 bytes of user data, which isn't what's being asked for.
+	if(header24[16 + 2] & 0x20)
+	 return(-1);
+	return(24);
+ }
+
+ return(-1);
+}
+
 CDAccess* CDAccess_Open(const std::string& path, bool image_memcache)
 {
  CDAccess *ret = NULL;
 
  if(path.size() >= 4 && !strcasecmp(path.c_str() + path.size() - 4, ".ccd"))
   ret = new CDAccess_CCD(path, image_memcache);
+ else if(path.size() >= 4 && !strcasecmp(path.c_str() + path.size() - 4, ".hcd"))
+  ret = new CDAccess_HCD(path, image_memcache);
  else
   ret = new CDAccess_Image(path, image_memcache);
 
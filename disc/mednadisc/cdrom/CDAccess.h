@@ -21,8 +21,28 @@ class CDAccess
  // Writes 96 bytes into pwbuf, and returns 'true' otherwise.
  virtual bool Fast_Read_Raw_PW_TSRE(uint8* pwbuf, int32 lba) const noexcept = 0;
 
+ // Returns a pointer to the 2352 bytes of main channel data if the sector is stored as is in a mapped image,
+ // or NULL if it has to be built(cooked formats, compressed audio, pregaps, and so on).
+ //
+ // The pointer stays valid until the CDAccess is destroyed, and this is thread-safe re-entrant.
+ virtual const uint8* Map_Raw_Sector(int32 lba) const noexcept = 0;
+
+ // Makes the image data resident, can be called on another thread while sectors are being read.
+ virtual void Preload(void) noexcept = 0;
+
+ // Reads the 2048 bytes of user data straight into buf, without building the rest of the sector(sync, header, EDC/ECC, subchannel).
+ // Sectors without user data(mode 0, mode 2 form 2, anything not mode 1 or 2) read as zeroes.
+ //
+ // Returns false without touching buf if the sector needs to go through Read_Raw_Sector() instead.
+ virtual bool Fast_Read_User_Data(uint8 *buf, int32 lba) = 0;
+
  virtual void Read_TOC(CDUtility::TOC *toc) = 0;
 
+ protected:
+
+ // Where the user data starts in a raw sector with this sync + header(+ subheader), or -1 if it has none.
+ static int32 User_Data_Offset(const uint8 *header24);
+
  private:
  CDAccess(const CDAccess&);	// No copy constructor.
  CDAccess& operator=(const CDAccess&); // No assignment operator.
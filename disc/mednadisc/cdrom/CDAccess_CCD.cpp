@@ -96,7 +96,7 @@ static T CCD_ReadInt(CCD_Section &s, const std::string &propname, const bool hav
 }
 
 
-CDAccess_CCD::CDAccess_CCD(const std::string& path, bool image_memcache) : img_numsectors(0)
+CDAccess_CCD::CDAccess_CCD(const std::string& path, bool image_memcache) : img_map(NULL), img_numsectors(0)
 {
  Load(path, image_memcache);
 }
@@ -273,6 +273,11 @@ void CDAccess_CCD::Load(const std::string& path, bool image_memcache)
   if(ss % 2352)
    throw MDFN_Error(0, _("CCD image size is not evenly divisible by 2352."));
 
+  // Sectors are stored raw, so they can be served straight from the mapping.
+  img_map = img_stream->map();
+  if(img_map && img_stream->map_size() < ss)
+   img_map = NULL;
+
   if(ss > 0x7FFFFFFF)
    throw MDFN_Error(0, _("CCD image is too large."));
 
@@ -293,6 +298,17 @@ void CDAccess_CCD::Load(const std::string& path, bool image_memcache)
  }
 
  CheckSubQSanity();
+
+ //
+ // The SUB file is deinterleaved, interleave it once here so reads can just copy it
+ //
+ for(size_t s = 0; s < img_numsectors; s++)
+ {
+  uint8 deint[96];
+
+  memcpy(deint, &sub_data[s * 96], 96);
+  subpw_interleave(deint, &sub_data[s * 96]);
+ }
 }
 
 //
@@ -400,10 +416,15 @@ void CDAccess_CCD::Read_Raw_Sector(uint8 *buf, int32 lba)
   return;
  }
 
- img_stream->seek(lba * 2352, SEEK_SET);
- img_stream->read(buf, 2352);
+ if(img_map)
+  memcpy(buf, &img_map[(size_t)lba * 2352], 2352);
+ else
+ {
+  img_stream->seek(lba * 2352, SEEK_SET);
+  img_stream->read(buf, 2352);
+ }
 
- subpw_interleave(&sub_data[lba * 96], buf + 2352);
+ memcpy(buf + 2352, &sub_data[lba * 96], 96);
 }
 
 bool CDAccess_CCD::Fast_Read_Raw_PW_TSRE(uint8* pwbuf, int32 lba) const noexcept
@@ -420,11 +441,53 @@ bool CDAccess_CCD::Fast_Read_Raw_PW_TSRE(uint8* pwbuf, int32 lba) const noexcept
   return true;
  }
 
- subpw_interleave(&sub_data[lba * 96], pwbuf);
+ memcpy(pwbuf, &sub_data[lba * 96], 96);
+
+ return true;
+}
+
+const uint8* CDAccess_CCD::Map_Raw_Sector(int32 lba) const noexcept
+{
+ if(!img_map || lba < 0 || (size_t)lba >= img_numsectors)
+  return NULL;
+
+ return &img_map[(size_t)lba * 2352];
+}
+
+bool CDAccess_CCD::Fast_Read_User_Data(uint8 *buf, int32 lba)
+{
+ if(lba < 0 || (size_t)lba >= img_numsectors)
+  return false;
+
+ uint8 header[24];
+ const uint8 *sector = img_map ? &img_map[(size_t)lba * 2352] : NULL;
+
+ if(!sector)
+ {
+  img_stream->seek(lba * 2352, SEEK_SET);
+  img_stream->read(header, sizeof(header));
+ }
+
+ const int32 offset = User_Data_Offset(sector ? sector : header);
+
+ if(offset < 0)
+  memset(buf, 0, 2048);
+ else if(sector)
+  memcpy(buf, sector + offset, 2048);
+ else
+ {
+  img_stream->seek(lba * 2352 + offset, SEEK_SET);
+  img_stream->read(buf, 2048);
+ }
 
  return true;
 }
 
+void CDAccess_CCD::Preload(void) noexcept
+{
+ img_stream->preload();
+}
+
 void CDAccess_CCD::Read_TOC(CDUtility::TOC *toc)
 {
  *toc = tocd;
@@ -31,6 +31,12 @@ class CDAccess_CCD : public CDAccess
 
  virtual bool Fast_Read_Raw_PW_TSRE(uint8* pwbuf, int32 lba) const noexcept;
 
+ virtual const uint8* Map_Raw_Sector(int32 lba) const noexcept;
+
+ virtual void Preload(void) noexcept;
+
+ virtual bool Fast_Read_User_Data(uint8 *buf, int32 lba);
+
  virtual void Read_TOC(CDUtility::TOC *toc);
 
  private:
@@ -41,7 +47,8 @@ class CDAccess_CCD : public CDAccess
  void CheckSubQSanity(void);
 
  std::unique_ptr<Stream> img_stream;
- std::unique_ptr<uint8[]> sub_data;
+ const uint8* img_map;	// NULL if the image couldn't be mapped
+ std::unique_ptr<uint8[]> sub_data;	// interleaved, 96 bytes per sector
 
  size_t img_numsectors;
  CDUtility::TOC tocd;
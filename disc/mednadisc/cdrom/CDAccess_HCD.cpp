@@ -0,0 +1,544 @@
+/* Mednafen - Multi-system Emulator
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ */
+
+/*
+ File layout, all integers little endian:
+
+  magic "HUNKDISC"
+  uint32 version
+  uint32 hunk_sectors
+  int32 first_lba
+  uint32 num_sectors
+  uint32 num_hunks
+  uint8 first_track, last_track, disc_type, leadout_mode
+  101 TOC tracks: uint8 adr, control, valid, 0; uint32 lba
+  num_hunks index entries: uint64 offset, uint32 length, uint32 crc, uint8 codec
+  the hunks
+
+ A decompressed hunk of n sectors is n flag bytes(SECTOR_*), then the n 2352 byte main channels, then the n 96 byte interleaved
+ subchannels.  Sectors with a SECTOR_* flag are stored without the parts that are rebuilt when the hunk is read(sync, header,
+ EDC and ECC), which don't compress.  Hunks of CD-DA sectors have their main channel delta coded a sample(4 bytes) apart.
+*/
+
+#include "slim_types.h"
+#include "../general.h"
+#include "../mdfn_endian.h"
+#include "CDAccess_HCD.h"
+#include "dvdisaster.h"
+
+#include <algorithm>
+
+#include <zlib.h>
+#include <lzma.h>
+
+//wrapper to repair gettext stuff
+#define _(X) X
+
+using namespace CDUtility;
+
+static const char HCD_MAGIC[8] = { 'H', 'U', 'N', 'K', 'D', 'I', 'S', 'C' };
+
+enum
+{
+ HCD_VERSION = 1,
+ HCD_HUNK_SECTORS = 8,	// bigger hunks hardly compress any better, and every read outside the cache decompresses a whole hunk
+ HCD_FIRST_LBA = -150,
+ HCD_HEADER_SIZE = 8 + 5 * 4 + 4 + 101 * 8,
+ HCD_INDEX_ENTRY_SIZE = 8 + 4 + 4 + 1,
+
+ HUNK_AUDIO = 0x80
+};
+
+enum
+{
+ SECTOR_MODE1 = 0x01,
+ SECTOR_MODE2_FORM1 = 0x02
+};
+
+static const uint8 SectorSync[12] = { 0x00, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0x00 };
+
+static uint32 HunkSize(uint32 count)
+{
+ return count * (1 + 2352 + 96);
+}
+
+// Raw LZMA2 with no container, the dictionary never needs to be bigger than a hunk.
+static void SetupLZMA(lzma_options_lzma* opt, lzma_filter* filters, uint32 max_size)
+{
+ lzma_lzma_preset(opt, LZMA_PRESET_DEFAULT);
+ opt->dict_size = std::max<uint32>(max_size, LZMA_DICT_SIZE_MIN);
+
+ filters[0].id = LZMA_FILTER_LZMA2;
+ filters[0].options = opt;
+ filters[1].id = LZMA_VLI_UNKNOWN;
+ filters[1].options = NULL;
+}
+
+// Returns the SECTOR_* flag and clears the parts of the sector that will be rebuilt, if rebuilding it gives back the exact same
+// sector.  Returns 0 for sectors stored as they are.
+static uint8 StripSector(uint8 *sector, int32 lba)
+{
+ uint8 rebuilt[2352];
+
+ if(memcmp(sector, SectorSync, sizeof(SectorSync)))
+  return(0);
+
+ memset(rebuilt, 0, sizeof(rebuilt));
+
+ if(sector[12 + 3] == 0x01)
+ {
+  memcpy(rebuilt + 16, sector + 16, 2048);
+  encode_mode1_sector(LBA_to_ABA(lba), rebuilt);
+
+  if(!memcmp(rebuilt, sector, 2352))
+  {
+   memset(sector, 0, 16);
+   memset(sector + 2064, 0, 2352 - 2064);
+   return(SECTOR_MODE1);
+  }
+ }
+ else if(sector[12 + 3] == 0x02 && !(sector[16 + 2] & 0x20))
+ {
+  memcpy(rebuilt + 16, sector + 16, 2048 + 8);
+  encode_mode2_form1_sector(LBA_to_ABA(lba), rebuilt);
+
+  if(!memcmp(rebuilt, sector, 2352))
+  {
+   memset(sector, 0, 16);
+   memset(sector + 2072, 0, 2352 - 2072);
+   return(SECTOR_MODE2_FORM1);
+  }
+ }
+
+ return(0);
+}
+
+static void RebuildSector(uint8 *sector, int32 lba, uint8 flags)
+{
+ if(flags & SECTOR_MODE1)
+  encode_mode1_sector(LBA_to_ABA(lba), sector);
+ else if(flags & SECTOR_MODE2_FORM1)
+  encode_mode2_form1_sector(LBA_to_ABA(lba), sector);
+}
+
+CDAccess_HCD::CDAccess_HCD(const std::string& path, bool image_memcache) : img_map(NULL), hunk_sectors(0), first_lba(0), num_sectors(0), leadout_mode(0xFF)
+{
+ Load(path, image_memcache);
+}
+
+CDAccess_HCD::~CDAccess_HCD()
+{
+
+}
+
+void CDAccess_HCD::Load(const std::string& path, bool image_memcache)
+{
+ uint8 magic[sizeof(HCD_MAGIC)];
+ uint32 num_hunks;
+ uint32 max_length = 0;
+
+ if(image_memcache)
+  img_stream.reset(new MemoryStream(new FileStream(path, FileStream::MODE_READ)));
+ else
+  img_stream.reset(new FileStream(path, FileStream::MODE_READ));
+
+ const uint64 size = img_stream->size();
+
+ if(size < HCD_HEADER_SIZE)
+  throw MDFN_Error(0, _("HCD file is too small."));
+
+ img_stream->read(magic, sizeof(magic));
+
+ if(memcmp(magic, HCD_MAGIC, sizeof(HCD_MAGIC)))
+  throw MDFN_Error(0, _("Not an HCD file."));
+
+ if(img_stream->get_LE<uint32>() != HCD_VERSION)
+  throw MDFN_Error(0, _("Unsupported HCD version."));
+
+ hunk_sectors = img_stream->get_LE<uint32>();
+ first_lba = (int32)img_stream->get_LE<uint32>();
+ num_sectors = img_stream->get_LE<uint32>();
+ num_hunks = img_stream->get_LE<uint32>();
+
+ if(!hunk_sectors || hunk_sectors > 1024)
+  throw MDFN_Error(0, _("Bad HCD hunk size of %u sectors."), hunk_sectors);
+
+ if(num_hunks != (num_sectors + hunk_sectors - 1) / hunk_sectors)
+  throw MDFN_Error(0, _("HCD hunk count doesn't match its sector count."));
+
+ tocd.first_track = img_stream->get_u8();
+ tocd.last_track = img_stream->get_u8();
+ tocd.disc_type = img_stream->get_u8();
+ leadout_mode = img_stream->get_u8();
+
+ for(unsigned t = 0; t <= 100; t++)
+ {
+  tocd.tracks[t].adr = img_stream->get_u8();
+  tocd.tracks[t].control = img_stream->get_u8();
+  tocd.tracks[t].valid = img_stream->get_u8();
+  img_stream->get_u8();
+  tocd.tracks[t].lba = img_stream->get_LE<uint32>();
+ }
+
+ if((int64)tocd.tracks[100].lba != (int64)first_lba + num_sectors)
+  throw MDFN_Error(0, _("HCD sector count doesn't end at the leadout."));
+
+ //
+ // Hunk index
+ //
+ if((uint64)num_hunks * HCD_INDEX_ENTRY_SIZE > size - HCD_HEADER_SIZE)
+  throw MDFN_Error(0, _("HCD hunk index is truncated."));
+
+ hunks.resize(num_hunks);
+
+ for(uint32 h = 0; h < num_hunks; h++)
+ {
+  HunkInfo* hi = &hunks[h];
+  const uint32 expected = HunkSize(std::min<uint32>(hunk_sectors, num_sectors - h * hunk_sectors));
+
+  hi->offset = img_stream->get_LE<uint64>();
+  hi->length = img_stream->get_LE<uint32>();
+  hi->crc = img_stream->get_LE<uint32>();
+  hi->codec = img_stream->get_u8();
+
+  if(hi->offset > size || hi->length > size - hi->offset)
+   throw MDFN_Error(0, _("HCD hunk %u is past the end of the file."), h);
+
+  switch(hi->codec & ~HUNK_AUDIO)
+  {
+   default:
+	throw MDFN_Error(0, _("HCD hunk %u has unknown codec %u."), h, hi->codec & ~HUNK_AUDIO);
+
+   case CODEC_STORED:
+	if(hi->length != expected)
+	 throw MDFN_Error(0, _("HCD hunk %u has the wrong size."), h);
+	break;
+
+   case CODEC_DEFLATE:
+   case CODEC_LZMA:
+	break;
+  }
+
+  max_length = std::max<uint32>(max_length, hi->length);
+ }
+
+ // Compressed hunks are decompressed straight out of the mapping.
+ img_map = img_stream->map();
+ if(img_map && img_stream->map_size() < size)
+  img_map = NULL;
+
+ if(!img_map)
+  comp_buf.reset(new uint8[max_length]);
+
+ hunk_buf.reset(new uint8[HunkSize(hunk_sectors)]);
+ cache_data.reset(new uint8[(size_t)CACHE_HUNKS * hunk_sectors * (2352 + 96)]);
+
+ for(unsigned i = 0; i < CACHE_HUNKS; i++)
+  cache_tags[i] = -1;
+}
+
+void CDAccess_HCD::Decode_Hunk(uint32 hunk, uint8* out)
+{
+ const HunkInfo* hi = &hunks[hunk];
+ const uint32 count = std::min<uint32>(hunk_sectors, num_sectors - hunk * hunk_sectors);
+ const uint32 size = HunkSize(count);
+ const uint8* comp;
+ const uint8* data = hunk_buf.get();
+
+ if(img_map)
+  comp = img_map + hi->offset;
+ else
+ {
+  img_stream->seek(hi->offset, SEEK_SET);
+  img_stream->read(comp_buf.get(), hi->length);
+  comp = comp_buf.get();
+ }
+
+ switch(hi->codec & ~HUNK_AUDIO)
+ {
+  case CODEC_STORED:
+	data = comp;
+	break;
+
+  case CODEC_DEFLATE:
+	{
+	 uLongf out_size = size;
+
+	 if(uncompress(hunk_buf.get(), &out_size, comp, hi->length) != Z_OK || out_size != size)
+	  throw MDFN_Error(0, _("HCD hunk %u failed to decompress."), hunk);
+	}
+	break;
+
+  case CODEC_LZMA:
+	{
+	 lzma_options_lzma opt;
+	 lzma_filter filters[2];
+	 size_t in_pos = 0, out_pos = 0;
+
+	 SetupLZMA(&opt, filters, HunkSize(hunk_sectors));
+
+	 if(lzma_raw_buffer_decode(filters, NULL, comp, &in_pos, hi->length, hunk_buf.get(), &out_pos, size) != LZMA_OK || out_pos != size)
+	  throw MDFN_Error(0, _("HCD hunk %u failed to decompress."), hunk);
+	}
+	break;
+ }
+
+ if(EDCCrc32(data, size) != hi->crc)
+  throw MDFN_Error(0, _("HCD hunk %u is corrupt."), hunk);
+
+ // The main channels are contiguous in the hunk, so the samples can be summed straight across sectors before they're split up.
+ if(hi->codec & HUNK_AUDIO)
+ {
+  uint8* samples = hunk_buf.get() + count;
+
+  if(data != hunk_buf.get())
+  {
+   memcpy(hunk_buf.get(), data, size);
+   data = hunk_buf.get();
+  }
+
+  for(uint32 j = 4; j < count * 2352; j++)
+   samples[j] += samples[j - 4];
+ }
+
+ const uint8* flags = data;
+ const uint8* main = data + count;
+ const uint8* sub = main + count * 2352;
+
+ for(uint32 i = 0; i < count; i++)
+ {
+  memcpy(out + i * (2352 + 96), main + i * 2352, 2352);
+  memcpy(out + i * (2352 + 96) + 2352, sub + i * 96, 96);
+ }
+
+ for(uint32 i = 0; i < count; i++)
+  RebuildSector(out + i * (2352 + 96), first_lba + hunk * hunk_sectors + i, flags[i]);
+}
+
+const uint8* CDAccess_HCD::Get_Sector(int32 lba)
+{
+ const uint32 index = lba - first_lba;
+ const uint32 hunk = index / hunk_sectors;
+ const unsigned slot = hunk % CACHE_HUNKS;
+ uint8* data = &cache_data[(size_t)slot * hunk_sectors * (2352 + 96)];
+
+ if(cache_tags[slot] != hunk)
+ {
+  cache_tags[slot] = -1;
+  Decode_Hunk(hunk, data);
+  cache_tags[slot] = hunk;
+ }
+
+ return data + (index % hunk_sectors) * (2352 + 96);
+}
+
+void CDAccess_HCD::Synth_Sector(uint8 *buf, int32 lba) const
+{
+ if(lba < first_lba)
+  synth_udapp_sector_lba(0xFF, tocd, lba, 0, buf);
+ else
+  synth_leadout_sector_lba(leadout_mode, tocd, lba, buf);
+}
+
+void CDAccess_HCD::Read_Raw_Sector(uint8 *buf, int32 lba)
+{
+ if(lba < first_lba || (int64)lba >= (int64)first_lba + num_sectors)
+ {
+  Synth_Sector(buf, lba);
+  return;
+ }
+
+ memcpy(buf, Get_Sector(lba), 2352 + 96);
+}
+
+bool CDAccess_HCD::Fast_Read_Raw_PW_TSRE(uint8* pwbuf, int32 lba) const noexcept
+{
+ if(lba < first_lba)
+ {
+  subpw_synth_udapp_lba(tocd, lba, 0, pwbuf);
+  return true;
+ }
+
+ if((int64)lba >= (int64)first_lba + num_sectors)
+ {
+  subpw_synth_leadout_lba(tocd, lba, pwbuf);
+  return true;
+ }
+
+ // Stored sectors share the hunk cache.
+ return false;
+}
+
+const uint8* CDAccess_HCD::Map_Raw_Sector(int32 lba) const noexcept
+{
+ return NULL;
+}
+
+bool CDAccess_HCD::Fast_Read_User_Data(uint8 *buf, int32 lba)
+{
+ // Every stored sector means decompressing its hunk, so user data is read through Read_Raw_Sector() like everything else,
+ // which lets disc_impl cache the sectors and decompress hunks ahead of time on its worker thread.
+ return(false);
+}
+
+void CDAccess_HCD::Preload(void) noexcept
+{
+ img_stream->preload();
+}
+
+void CDAccess_HCD::Read_TOC(CDUtility::TOC *toc)
+{
+ *toc = tocd;
+}
+
+void CDAccess_HCD::Convert(CDAccess* src, const std::string& path, int codec)
+{
+ TOC toc;
+ uint8 buf[2352 + 96];
+
+ if(codec != CODEC_DEFLATE && codec != CODEC_LZMA)
+  throw MDFN_Error(0, _("Unknown HCD codec %d."), codec);
+
+ src->Read_TOC(&toc);
+
+ const uint32 num_sectors = toc.tracks[100].lba - HCD_FIRST_LBA;
+ const uint32 num_hunks = (num_sectors + HCD_HUNK_SECTORS - 1) / HCD_HUNK_SECTORS;
+
+ // The leadout isn't stored, it's synthesized in the data mode of the source's leadout.
+ src->Read_Raw_Sector(buf, toc.tracks[100].lba);
+ const uint8 leadout_mode = (buf[2352 + 1] & 0x40) ? buf[12 + 3] : 0xFF;
+
+ FileStream fp(path, FileStream::MODE_WRITE);
+
+ fp.write(HCD_MAGIC, sizeof(HCD_MAGIC));
+ fp.put_LE<uint32>(HCD_VERSION);
+ fp.put_LE<uint32>(HCD_HUNK_SECTORS);
+ fp.put_LE<uint32>((uint32)HCD_FIRST_LBA);
+ fp.put_LE<uint32>(num_sectors);
+ fp.put_LE<uint32>(num_hunks);
+ fp.put_u8(toc.first_track);
+ fp.put_u8(toc.last_track);
+ fp.put_u8(toc.disc_type);
+ fp.put_u8(leadout_mode);
+
+ for(unsigned t = 0; t <= 100; t++)
+ {
+  fp.put_u8(toc.tracks[t].adr);
+  fp.put_u8(toc.tracks[t].control);
+  fp.put_u8(toc.tracks[t].valid);
+  fp.put_u8(0);
+  fp.put_LE<uint32>(toc.tracks[t].lba);
+ }
+
+ //
+ // The index is filled in once the hunks have been written.
+ //
+ const uint64 index_offset = fp.tell();
+ std::vector<HunkInfo> index(num_hunks);
+ std::unique_ptr<uint8[]> zeroes(new uint8[(size_t)num_hunks * HCD_INDEX_ENTRY_SIZE]());
+
+ fp.write(zeroes.get(), (uint64)num_hunks * HCD_INDEX_ENTRY_SIZE);
+
+ const uint32 max_size = HunkSize(HCD_HUNK_SECTORS);
+ const size_t comp_max = std::max<size_t>(compressBound(max_size), lzma_stream_buffer_bound(max_size));
+ std::unique_ptr<uint8[]> data(new uint8[max_size]);
+ std::unique_ptr<uint8[]> comp(new uint8[comp_max]);
+
+ for(uint32 h = 0; h < num_hunks; h++)
+ {
+  const uint32 count = std::min<uint32>(HCD_HUNK_SECTORS, num_sectors - h * HCD_HUNK_SECTORS);
+  const uint32 size = HunkSize(count);
+  uint8* flags = data.get();
+  uint8* main = flags + count;
+  uint8* sub = main + count * 2352;
+  bool audio = true;
+  size_t comp_size = 0;
+  HunkInfo* hi = &index[h];
+
+  for(uint32 i = 0; i < count; i++)
+  {
+   const int32 lba = HCD_FIRST_LBA + h * HCD_HUNK_SECTORS + i;
+
+   src->Read_Raw_Sector(buf, lba);
+
+   if(!memcmp(buf, SectorSync, sizeof(SectorSync)))
+    audio = false;
+
+   flags[i] = StripSector(buf, lba);
+   memcpy(main + i * 2352, buf, 2352);
+   memcpy(sub + i * 96, buf + 2352, 96);
+  }
+
+  if(audio)
+  {
+   for(uint32 j = count * 2352 - 1; j >= 4; j--)
+    main[j] -= main[j - 4];
+  }
+
+  hi->crc = EDCCrc32(data.get(), size);
+  hi->codec = codec;
+
+  if(codec == CODEC_DEFLATE)
+  {
+   uLongf out_size = comp_max;
+
+   if(compress2(comp.get(), &out_size, data.get(), size, Z_BEST_COMPRESSION) != Z_OK)
+    throw MDFN_Error(0, _("Failed to compress HCD hunk %u."), h);
+
+   comp_size = out_size;
+  }
+  else
+  {
+   lzma_options_lzma opt;
+   lzma_filter filters[2];
+
+   SetupLZMA(&opt, filters, max_size);
+
+   if(lzma_raw_buffer_encode(filters, NULL, data.get(), size, comp.get(), &comp_size, comp_max) != LZMA_OK)
+    throw MDFN_Error(0, _("Failed to compress HCD hunk %u."), h);
+  }
+
+  hi->offset = fp.tell();
+
+  if(comp_size >= size)
+  {
+   hi->codec = CODEC_STORED;
+   hi->length = size;
+   fp.write(data.get(), size);
+  }
+  else
+  {
+   hi->length = comp_size;
+   fp.write(comp.get(), comp_size);
+  }
+
+  if(audio)
+   hi->codec |= HUNK_AUDIO;
+ }
+
+ fp.seek(index_offset, SEEK_SET);
+
+ for(uint32 h = 0; h < num_hunks; h++)
+ {
+  fp.put_LE<uint64>(index[h].offset);
+  fp.put_LE<uint32>(index[h].length);
+  fp.put_LE<uint32>(index[h].crc);
+  fp.put_u8(index[h].codec);
+ }
+
+ fp.close();
+}
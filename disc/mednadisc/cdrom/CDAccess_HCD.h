@@ -0,0 +1,91 @@
+/* Mednafen - Multi-system Emulator
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ */
+
+#include "../FileStream.h"
+#include "../MemoryStream.h"
+#include "CDAccess.h"
+#include <memory>
+#include <vector>
+
+//
+// Hunk compressed disc images(.hcd): the raw 2352 + 96 byte sectors of a whole disc, from LBA -150 up to the leadout, split into
+// hunks of a few sectors that are compressed on their own.  An index of the hunks lets any sector be read by decompressing just
+// its hunk, and recently decompressed hunks are kept around for the sectors after it.
+//
+class CDAccess_HCD : public CDAccess
+{
+ public:
+
+ enum
+ {
+  CODEC_STORED = 0,
+  CODEC_DEFLATE = 1,
+  CODEC_LZMA = 2
+ };
+
+ CDAccess_HCD(const std::string& path, bool image_memcache);
+ virtual ~CDAccess_HCD();
+
+ virtual void Read_Raw_Sector(uint8 *buf, int32 lba);
+
+ virtual bool Fast_Read_Raw_PW_TSRE(uint8* pwbuf, int32 lba) const noexcept;
+
+ virtual const uint8* Map_Raw_Sector(int32 lba) const noexcept;
+
+ virtual void Preload(void) noexcept;
+
+ virtual bool Fast_Read_User_Data(uint8 *buf, int32 lba);
+
+ virtual void Read_TOC(CDUtility::TOC *toc);
+
+ // Writes every sector 'src' has to a new image at 'path', with the hunks compressed by 'codec'(CODEC_DEFLATE or CODEC_LZMA).
+ static void Convert(CDAccess* src, const std::string& path, int codec);
+
+ private:
+
+ enum { CACHE_HUNKS = 32 };
+
+ struct HunkInfo
+ {
+  uint64 offset;
+  uint32 length;	// compressed
+  uint32 crc;	// crc32 of the decompressed hunk
+  uint8 codec;	// CODEC_*, | HUNK_AUDIO
+ };
+
+ void Load(const std::string& path, bool image_memcache);
+ void Synth_Sector(uint8 *buf, int32 lba) const;
+ const uint8* Get_Sector(int32 lba);
+ void Decode_Hunk(uint32 hunk, uint8* out);
+
+ std::unique_ptr<Stream> img_stream;
+ const uint8* img_map;	// NULL if the image couldn't be mapped
+
+ std::vector<HunkInfo> hunks;
+ std::unique_ptr<uint8[]> comp_buf;	// compressed hunk, when it isn't mapped
+ std::unique_ptr<uint8[]> hunk_buf;	// decompressed hunk, before the sectors are rebuilt from it
+
+ // Rebuilt sectors of recently read hunks, a hunk can only go in slot(hunk % CACHE_HUNKS).
+ std::unique_ptr<uint8[]> cache_data;
+ int64 cache_tags[CACHE_HUNKS];
+
+ uint32 hunk_sectors;
+ int32 first_lba;
+ uint32 num_sectors;
+ uint8 leadout_mode;
+ CDUtility::TOC tocd;
+};
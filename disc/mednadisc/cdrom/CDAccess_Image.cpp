@@ -53,9 +53,25 @@
 #include "CDAFReader.h"
 
 #include <map>
+#include <algorithm>
 
 using namespace CDUtility;
 
+#define SUBQ_REPLACEMENT_EMPTY 0xFFFFFFFF
+
+// Each Q byte spread over the 8 interleaved subchannel bytes it occupies(bit 6 of each).
+static const struct SubQSpreadTable
+{
+ uint8 bytes[256][8];
+
+ SubQSpreadTable()
+ {
+  for(unsigned v = 0; v < 256; v++)
+   for(unsigned bit = 0; bit < 8; bit++)
+    bytes[v][bit] = ((v >> (7 - bit)) & 1) ? 0x40 : 0x00;
+ }
+} SubQSpread;
+
 enum
 {
  CDRF_SUBM_NONE = 0,
@@ -241,6 +257,12 @@ void CDAccess_Image::ParseTOCFileLineInfo(CDRFILE_TRACK_INFO *track, const int t
   if(!track->AReader)
    throw MDFN_Error(0, "TODO ERROR");
  }
+ else
+ {
+  // Stream::map() caches the mapping, so every track in the same file gets the same pointer.
+  track->map = track->fp->map();
+  track->map_size = track->fp->map_size();
+ }
 
  sector_mult = DI_Size_Table[track->DIFormat];
 
@@ -341,6 +363,7 @@ void CDAccess_Image::LoadSBI(const std::string& sbi_path)
   try
   {
    FileStream sbis(sbi_path, FileStream::MODE_READ);
+   std::map<uint32, CDRFILE_SUBQ_REPLACEMENT> replacements;
    uint8 header[4];
    uint8 ed[4 + 10];
    uint8 tmpq[12];
@@ -373,9 +396,28 @@ void CDAccess_Image::LoadSBI(const std::string& sbi_path)
 
     uint32 aba = AMSF_to_ABA(BCD_to_U8(ed[0]), BCD_to_U8(ed[1]), BCD_to_U8(ed[2]));
 
-    memcpy(SubQReplaceMap[aba].data(), tmpq, 12);
+    replacements[aba].aba = aba;
+    memcpy(replacements[aba].data, tmpq, 12);
    }
-   printf(_("Loaded Q subchannel replacements for %zu sectors.\n"), SubQReplaceMap.size());
+
+   size_t table_size = 1;
+
+   while(table_size < replacements.size() * 2)
+    table_size <<= 1;
+
+   SubQReplaceTable.assign(table_size, CDRFILE_SUBQ_REPLACEMENT({ SUBQ_REPLACEMENT_EMPTY, { 0 } }));
+
+   for(auto& r : replacements)
+   {
+    size_t slot = r.first & (table_size - 1);
+
+    while(SubQReplaceTable[slot].aba != SUBQ_REPLACEMENT_EMPTY)
+     slot = (slot + 1) & (table_size - 1);
+
+    SubQReplaceTable[slot] = r.second;
+   }
+
+   printf(_("Loaded Q subchannel replacements for %zu sectors.\n"), replacements.size());
   }
   catch(MDFN_Error &e)
   {
@@ -677,6 +719,8 @@ void CDAccess_Image::ImageOpen(const std::string& path, bool image_memcache)
       //struct stat stat_buf;
       //fstat(fileno(TmpTrack.fp), &stat_buf);
       //TmpTrack.sectors = stat_buf.st_size; // / 2048;
+      TmpTrack.map = TmpTrack.fp->map();
+      TmpTrack.map_size = TmpTrack.fp->map_size();
      }
      else if(!strcasecmp(args[1].c_str(), "OGG") || !strcasecmp(args[1].c_str(), "VORBIS") || !strcasecmp(args[1].c_str(), "WAVE") || !strcasecmp(args[1].c_str(), "WAV") || !strcasecmp(args[1].c_str(), "PCM")
 	|| !strcasecmp(args[1].c_str(), "MPC") || !strcasecmp(args[1].c_str(), "MP+"))
@@ -938,6 +982,7 @@ void CDAccess_Image::ImageOpen(const std::string& path, bool image_memcache)
  }
 
  GenerateTOC();
+ GenerateSubQRegions();
 }
 
 void CDAccess_Image::Cleanup(void)
@@ -1097,30 +1142,28 @@ void CDAccess_Image::Read_Raw_Sector(uint8 *buf, int32 lba)
     if(ct->SubchannelMode)
      SeekPos += 96 * (lba - ct->LBA);
 
-    ct->fp->seek(SeekPos, SEEK_SET);
-
     switch(ct->DIFormat)
     {
 	case DI_FORMAT_AUDIO:
-		ct->fp->read(buf, 2352);
+		ReadTrackData(ct, SeekPos, buf, 2352);
 
 		if(ct->RawAudioMSBFirst)
 		 Endian_A16_Swap(buf, 588 * 2);
 		break;
 
 	case DI_FORMAT_MODE1:
-		ct->fp->read(buf + 12 + 3 + 1, 2048);
+		ReadTrackData(ct, SeekPos, buf + 12 + 3 + 1, 2048);
 		encode_mode1_sector(lba + 150, buf);
 		break;
 
 	case DI_FORMAT_MODE1_RAW:
 	case DI_FORMAT_MODE2_RAW:
 	case DI_FORMAT_CDI_RAW:
-		ct->fp->read(buf, 2352);
+		ReadTrackData(ct, SeekPos, buf, 2352);
 		break;
 
 	case DI_FORMAT_MODE2:
-		ct->fp->read(buf + 16, 2336);
+		ReadTrackData(ct, SeekPos, buf + 16, 2336);
 		encode_mode2_sector(lba + 150, buf);
 		break;
 
@@ -1128,23 +1171,144 @@ void CDAccess_Image::Read_Raw_Sector(uint8 *buf, int32 lba)
 	// FIXME: M2F1, M2F2, does sub-header come before or after user data(standards say before, but I wonder
 	// about cdrdao...).
 	case DI_FORMAT_MODE2_FORM1:
-		ct->fp->read(buf + 24, 2048);
+		ReadTrackData(ct, SeekPos, buf + 24, 2048);
 		//encode_mode2_form1_sector(lba + 150, buf);
 		break;
 
 	case DI_FORMAT_MODE2_FORM2:
-		ct->fp->read(buf + 24, 2324);
+		ReadTrackData(ct, SeekPos, buf + 24, 2324);
 		//encode_mode2_form2_sector(lba + 150, buf);
 		break;
 
     }
 
     if(ct->SubchannelMode)
-     ct->fp->read(buf + 2352, 96);
+     ReadTrackData(ct, SeekPos + DI_Size_Table[ct->DIFormat], buf + 2352, 96);
    }
   } // end if audible part of audio track read.
 }
 
+void CDAccess_Image::ReadTrackData(CDRFILE_TRACK_INFO *track, long offset, uint8 *buf, uint32 count)
+{
+ if(track->map && (uint64)offset + count <= track->map_size)
+  memcpy(buf, track->map + offset, count);
+ else
+ {
+  track->fp->seek(offset, SEEK_SET);
+  track->fp->read(buf, count);
+ }
+}
+
+int32 CDAccess_Image::FindTrack(int32 lba) const
+{
+ // Same lookup as MakeSubPQ(), so a sector in between tracks is attributed the same way.
+ const CDRFILE_SUBQ_REGION *region = FindSubQRegion(lba);
+
+ return(region ? region->track : -1);
+}
+
+const uint8* CDAccess_Image::Map_Raw_Sector(int32 lba) const noexcept
+{
+ int32 track;
+
+ if(lba >= total_sectors || (track = FindTrack(lba)) < 0)
+  return(NULL);
+
+ const CDRFILE_TRACK_INFO *ct = &Tracks[track];
+
+ if(!ct->map || lba < (ct->LBA - ct->pregap_dv) || lba >= (ct->LBA + ct->sectors))
+  return(NULL);
+
+ switch(ct->DIFormat)
+ {
+  case DI_FORMAT_AUDIO:
+	if(ct->RawAudioMSBFirst)
+	 return(NULL);
+	break;
+
+  case DI_FORMAT_MODE1_RAW:
+  case DI_FORMAT_MODE2_RAW:
+  case DI_FORMAT_CDI_RAW:
+	break;
+
+  default:
+	return(NULL);
+ }
+
+ long SeekPos = ct->FileOffset + (lba - ct->LBA) * (2352 + (ct->SubchannelMode ? 96 : 0));
+
+ if(SeekPos < 0 || (uint64)SeekPos + 2352 > ct->map_size)
+  return(NULL);
+
+ return(ct->map + SeekPos);
+}
+
+bool CDAccess_Image::Fast_Read_User_Data(uint8 *buf, int32 lba)
+{
+ int32 track;
+
+ if(lba >= total_sectors || (track = FindTrack(lba)) < 0)
+  return(false);
+
+ CDRFILE_TRACK_INFO *ct = &Tracks[track];
+
+ // Pregaps and postgaps are synthesized, and audio has no user data(but still has to read the same as Read_Raw_Sector() would).
+ if(ct->AReader || lba < (ct->LBA - ct->pregap_dv) || lba >= (ct->LBA + ct->sectors))
+  return(false);
+
+ long SeekPos = ct->FileOffset + (lba - ct->LBA) * (DI_Size_Table[ct->DIFormat] + (ct->SubchannelMode ? 96 : 0));
+
+ switch(ct->DIFormat)
+ {
+  default:
+	return(false);
+
+  case DI_FORMAT_MODE1:
+	ReadTrackData(ct, SeekPos, buf, 2048);
+	break;
+
+  case DI_FORMAT_MODE2:
+	{
+	 uint8 subheader[8];
+
+	 ReadTrackData(ct, SeekPos, subheader, sizeof(subheader));
+
+	 if(subheader[2] & 0x20)
+	  memset(buf, 0, 2048);
+	 else
+	  ReadTrackData(ct, SeekPos + 8, buf, 2048);
+	}
+	break;
+
+  case DI_FORMAT_MODE1_RAW:
+  case DI_FORMAT_MODE2_RAW:
+  case DI_FORMAT_CDI_RAW:
+	{
+	 uint8 header[24];
+	 int32 offset;
+
+	 ReadTrackData(ct, SeekPos, header, sizeof(header));
+
+	 if((offset = User_Data_Offset(header)) < 0)
+	  memset(buf, 0, 2048);
+	 else
+	  ReadTrackData(ct, SeekPos + offset, buf, 2048);
+	}
+	break;
+ }
+
+ return(true);
+}
+
+void CDAccess_Image::Preload(void) noexcept
+{
+ for(int32 track = FirstTrack; track < (FirstTrack + NumTracks); track++)
+ {
+  if(Tracks[track].FirstFileInstance && Tracks[track].fp && !Tracks[track].AReader)
+   Tracks[track].fp->preload();
+ }
+}
+
 bool CDAccess_Image::Fast_Read_Raw_PW_TSRE(uint8* pwbuf, int32 lba) const noexcept
 {
  int32 track;
@@ -1180,29 +1344,18 @@ bool CDAccess_Image::Fast_Read_Raw_PW_TSRE(uint8* pwbuf, int32 lba) const noexce
 int32 CDAccess_Image::MakeSubPQ(int32 lba, uint8 *SubPWBuf) const
 {
  uint8 buf[0xC];
- int32 track;
  uint32 lba_relative;
  uint32 ma, sa, fa;
  uint32 m, s, f;
- uint8 pause_or = 0x00;
- bool track_found = false;
-
- for(track = FirstTrack; track < (FirstTrack + NumTracks); track++)
- {
-  if(lba >= (Tracks[track].LBA - Tracks[track].pregap_dv - Tracks[track].pregap) && lba < (Tracks[track].LBA + Tracks[track].sectors + Tracks[track].postgap))
-  {
-   track_found = true;
-   break;
-  }
- }
+ const CDRFILE_SUBQ_REGION *region = FindSubQRegion(lba);
 
- if(!track_found)
+ if(!region)
   throw(MDFN_Error(0, _("Could not find track for sector %u!"), lba));
 
- if(lba < Tracks[track].LBA)
-  lba_relative = Tracks[track].LBA - 1 - lba;
+ if(region->pregap)
+  lba_relative = region->track_lba - 1 - lba;
  else
-  lba_relative = lba - Tracks[track].LBA;
+  lba_relative = lba - region->track_lba;
 
  f = (lba_relative % 75);
  s = ((lba_relative / 75) % 60);
@@ -1212,75 +1365,163 @@ int32 CDAccess_Image::MakeSubPQ(int32 lba, uint8 *SubPWBuf) const
  sa = ((lba + 150) / 75) % 60;
  ma = ((lba + 150) / 75 / 60);
 
- uint8 adr = 0x1; // Q channel data encodes position
- uint8 control = Tracks[track].subq_control;
+ buf[0] = region->adr_control;
+ buf[1] = U8_to_BCD(region->track);
+ buf[2] = region->index_bcd;
+
+ // Track relative MSF address
+ buf[3] = U8_to_BCD(m);
+ buf[4] = U8_to_BCD(s);
+ buf[5] = U8_to_BCD(f);
+
+ buf[6] = 0; // Zerroooo
+
+ // Absolute MSF address
+ buf[7] = U8_to_BCD(ma);
+ buf[8] = U8_to_BCD(sa);
+ buf[9] = U8_to_BCD(fa);
+
+ const uint8 *replacement = FindSubQReplacement(LBA_to_ABA(lba));
+
+ if(replacement)
+  memcpy(buf, replacement, 12);
+ else
+  subq_generate_checksum(buf);
 
- // Handle pause(D7 of interleaved subchannel byte) bit, should be set to 1 when in pregap or postgap.
- if((lba < Tracks[track].LBA) || (lba >= Tracks[track].LBA + Tracks[track].sectors))
+ for(int i = 0; i < 12; i++)
  {
-  //printf("pause_or = 0x80 --- %d\n", lba);
-  pause_or = 0x80;
+  const uint8 *spread = SubQSpread.bytes[buf[i]];
+
+  for(int bit = 0; bit < 8; bit++)
+   SubPWBuf[i * 8 + bit] |= spread[bit] | region->pause_or;
  }
 
- // Handle pregap between audio->data track
+ return region->track;
+}
+
+const CDRFILE_SUBQ_REGION *CDAccess_Image::FindSubQRegion(int32 lba) const
+{
+ size_t lo = 0;
+ size_t hi = SubQRegions.size();
+
+ // Last region starting at or before lba.
+ while(lo < hi)
  {
-  int32 pg_offset = (int32)lba - Tracks[track].LBA;
+  size_t mid = (lo + hi) / 2;
+
+  if(SubQRegions[mid].start <= lba)
+   lo = mid + 1;
+  else
+   hi = mid;
+ }
+
+ if(!lo || lba >= SubQRegions[lo - 1].end)
+  return(NULL);
+
+ return(&SubQRegions[lo - 1]);
+}
+
+const uint8 *CDAccess_Image::FindSubQReplacement(uint32 aba) const
+{
+ const size_t mask = SubQReplaceTable.size() - 1;
+
+ if(SubQReplaceTable.empty())
+  return(NULL);
+
+ for(size_t slot = aba & mask; SubQReplaceTable[slot].aba != SUBQ_REPLACEMENT_EMPTY; slot = (slot + 1) & mask)
+ {
+  if(SubQReplaceTable[slot].aba == aba)
+   return(SubQReplaceTable[slot].data);
+ }
+
+ return(NULL);
+}
+
+//
+// Splits every track(pregap through postgap) into runs of sectors with the same Q subchannel apart from the addresses.
+// Where track ranges overlap the earlier track wins, the same as searching the tracks in order would.
+//
+void CDAccess_Image::GenerateSubQRegions(void)
+{
+ SubQRegions.clear();
+
+ for(int32 track = FirstTrack; track < (FirstTrack + NumTracks); track++)
+ {
+  const CDRFILE_TRACK_INFO *ct = &Tracks[track];
+  const int32 lo = ct->LBA - ct->pregap_dv - ct->pregap;
+  const int32 hi = ct->LBA + ct->sectors + ct->postgap;
+  uint8 pregap_control = ct->subq_control;
 
   // If we're more than 2 seconds(150 sectors) from the real "start" of the track/INDEX 01, and the track is a data track,
   // and the preceding track is an audio track, encode it as audio(by taking the SubQ control field from the preceding track).
   //
   // TODO: Look into how we're supposed to handle subq control field in the four combinations of track types(data/audio).
   //
-  if(pg_offset < -150)
+  if((ct->subq_control & SUBQ_CTRLF_DATA) && (FirstTrack < track) && !(Tracks[track - 1].subq_control & SUBQ_CTRLF_DATA))
+   pregap_control = Tracks[track - 1].subq_control;
+
+  // Pause(D7 of interleaved subchannel byte) bit is set in the pregap and postgap, and the index is 00 in the pregap.
+  const struct
   {
-   if((Tracks[track].subq_control & SUBQ_CTRLF_DATA) && (FirstTrack < track) && !(Tracks[track - 1].subq_control & SUBQ_CTRLF_DATA))
-   {
-    //printf("Pregap part 1 audio->data: lba=%d track_lba=%d\n", lba, Tracks[track].LBA);
-    control = Tracks[track - 1].subq_control;
-   }
-  }
- }
+   int32 start;
+   int32 end;
+   uint8 control;
+   bool pregap;
+   uint8 pause_or;
+  } parts[4] =
+  {
+   { lo, ct->LBA - 150, pregap_control, true, 0x80 },
+   { ct->LBA - 150, ct->LBA, ct->subq_control, true, 0x80 },
+   { ct->LBA, ct->LBA + ct->sectors, ct->subq_control, false, 0x00 },
+   { ct->LBA + ct->sectors, hi, ct->subq_control, false, 0x80 },
+  };
 
+  const size_t existing = SubQRegions.size();
 
- memset(buf, 0, 0xC);
- buf[0] = (adr << 0) | (control << 4);
- buf[1] = U8_to_BCD(track);
+  for(auto& part : parts)
+  {
+   std::vector<std::pair<int32, int32>> pieces = { { std::max(part.start, lo), std::min(part.end, hi) } };
 
- if(lba < Tracks[track].LBA) // Index is 00 in pregap
-  buf[2] = U8_to_BCD(0x00);
- else
-  buf[2] = U8_to_BCD(0x01);
+   // Carve out whatever earlier tracks already cover.
+   for(size_t i = 0; i < existing; i++)
+   {
+    const CDRFILE_SUBQ_REGION &r = SubQRegions[i];
+    std::vector<std::pair<int32, int32>> remaining;
 
- // Track relative MSF address
- buf[3] = U8_to_BCD(m);
- buf[4] = U8_to_BCD(s);
- buf[5] = U8_to_BCD(f);
+    for(auto& piece : pieces)
+    {
+     if(piece.first < r.start)
+      remaining.push_back({ piece.first, std::min(piece.second, r.start) });
 
- buf[6] = 0; // Zerroooo
+     if(piece.second > r.end)
+      remaining.push_back({ std::max(piece.first, r.end), piece.second });
+    }
 
- // Absolute MSF address
- buf[7] = U8_to_BCD(ma);
- buf[8] = U8_to_BCD(sa);
- buf[9] = U8_to_BCD(fa);
+    pieces = remaining;
+   }
 
- subq_generate_checksum(buf);
+   for(auto& piece : pieces)
+   {
+    if(piece.first >= piece.second)
+     continue;
 
- if(!SubQReplaceMap.empty())
- {
-  //printf("%d\n", lba);
-  auto it = SubQReplaceMap.find(LBA_to_ABA(lba));
+    CDRFILE_SUBQ_REGION region;
 
-  if(it != SubQReplaceMap.end())
-  {
-   //printf("Replace: %d\n", lba);
-   memcpy(buf, it->second.data(), 12);
+    region.start = piece.first;
+    region.end = piece.second;
+    region.track = track;
+    region.track_lba = ct->LBA;
+    region.pregap = part.pregap;
+    region.adr_control = 0x1 | (part.control << 4); // Q channel data encodes position
+    region.index_bcd = U8_to_BCD(part.pregap ? 0x00 : 0x01);
+    region.pause_or = part.pause_or;
+
+    SubQRegions.push_back(region);
+   }
   }
  }
 
- for(int i = 0; i < 96; i++)
-  SubPWBuf[i] |= (((buf[i >> 3] >> (7 - (i & 0x7))) & 1) ? 0x40 : 0x00) | pause_or;
-
- return track;
+ std::sort(SubQRegions.begin(), SubQRegions.end(), [](const CDRFILE_SUBQ_REGION &a, const CDRFILE_SUBQ_REGION &b) { return a.start < b.start; });
 }
 
 void CDAccess_Image::Read_TOC(TOC *rtoc)
@@ -2,7 +2,7 @@
 #define __MDFN_CDACCESS_IMAGE_H
 
 #include <map>
-#include <array>
+#include <vector>
 
 class Stream;
 class CDAFReader;
@@ -23,6 +23,8 @@ struct CDRFILE_TRACK_INFO
 
 	int32 sectors;	// Not including pregap sectors!
         Stream *fp;
+	const uint8 *map;	// Whole file, NULL if it couldn't be mapped.
+	uint64 map_size;
 	bool FirstFileInstance;
 	bool RawAudioMSBFirst;
 	long FileOffset;
@@ -32,6 +34,25 @@ struct CDRFILE_TRACK_INFO
 
 	CDAFReader *AReader;
 };
+
+// A run of sectors whose Q subchannel only differs by the MSF addresses.
+struct CDRFILE_SUBQ_REGION
+{
+	int32 start;	// First LBA.
+	int32 end;	// One past the last LBA.
+	int32 track;
+	int32 track_lba;
+	bool pregap;	// Track relative MSF counts down towards track_lba.
+	uint8 adr_control;
+	uint8 index_bcd;
+	uint8 pause_or;
+};
+
+struct CDRFILE_SUBQ_REPLACEMENT
+{
+	uint32 aba;	// SUBQ_REPLACEMENT_EMPTY if the slot is free.
+	uint8 data[12];
+};
 #if 0
 struct Medium_Chunk
 {
@@ -71,6 +92,12 @@ class CDAccess_Image : public CDAccess
 
  virtual bool Fast_Read_Raw_PW_TSRE(uint8* pwbuf, int32 lba) const noexcept;
 
+ virtual const uint8* Map_Raw_Sector(int32 lba) const noexcept;
+
+ virtual void Preload(void) noexcept;
+
+ virtual bool Fast_Read_User_Data(uint8 *buf, int32 lba);
+
  virtual void Read_TOC(CDUtility::TOC *toc);
 
  private:
@@ -83,18 +110,31 @@ class CDAccess_Image : public CDAccess
  CDRFILE_TRACK_INFO Tracks[100]; // Track #0(HMM?) through 99
  CDUtility::TOC toc;
 
- std::map<uint32, std::array<uint8, 12>> SubQReplaceMap;
+ // Sorted and non-overlapping, built from the tracks once the image is open.
+ std::vector<CDRFILE_SUBQ_REGION> SubQRegions;
+
+ // Open addressed with linear probing, the size is a power of 2 at least twice the number of replacements(or 0).
+ std::vector<CDRFILE_SUBQ_REPLACEMENT> SubQReplaceTable;
 
  std::string base_dir;
 
  void ImageOpen(const std::string& path, bool image_memcache);
  void LoadSBI(const std::string& sbi_path);
  void GenerateTOC(void);
+ void GenerateSubQRegions(void);
+ const CDRFILE_SUBQ_REGION *FindSubQRegion(int32 lba) const;
+ const uint8 *FindSubQReplacement(uint32 aba) const;
  void Cleanup(void);
 
  // MakeSubPQ will OR the simulated P and Q subchannel data into SubPWBuf.
  int32 MakeSubPQ(int32 lba, uint8 *SubPWBuf) const;
 
+ void ReadTrackData(CDRFILE_TRACK_INFO *track, long offset, uint8 *buf, uint32 count);
+
+ // Returns the track containing lba(including its pregap and postgap), or -1.
+ int32 FindTrack(int32 lba) const;
+
+
  void ParseTOCFileLineInfo(CDRFILE_TRACK_INFO *track, const int tracknum, const std::string &filename, const char *binoffset, const char *msfoffset, const char *length, bool image_memcache, std::map<std::string, Stream*> &toc_streamcache);
  uint32 GetSectorCount(CDRFILE_TRACK_INFO *track);
 };
@@ -21,6 +21,7 @@
 #include <assert.h>
 
 #include "slim_types.h"
+#include "mdfn_endian.h"
 #include "CDUtility.h"
 #include "dvdisaster.h"
 #include "lec.h"
@@ -195,21 +196,35 @@ void subq_deinterleave(const uint8 *SubPWBuf, uint8 *qbuf)
 }
 
 
+// The two P-W layouts are 12 8x8 bit matrices transposed into each other: bit (7 - ch) of interleaved byte (d * 8 + b) is
+// bit (7 - b) of deinterleaved byte (ch * 12 + d).  With the 8 bytes of one matrix in a little endian 64-bit word, that's a
+// flip of the word around its anti-diagonal, done in 3 rounds of swapping bit blocks(4x4, then 2x2, then 1x1).
+static INLINE uint64 subpw_transpose8x8(uint64 x)
+{
+ uint64 t;
+
+ t = x ^ (x << 36);
+ x ^= 0xF0F0F0F00F0F0F0FULL & (t ^ (x >> 36));
+ t = 0xCCCC0000CCCC0000ULL & (x ^ (x << 18));
+ x ^= t ^ (t >> 18);
+ t = 0xAA00AA00AA00AA00ULL & (x ^ (x << 9));
+ x ^= t ^ (t >> 9);
+
+ return(x);
+}
+
 // Deinterleaves 96 bytes of subchannel P-W data from 96 bytes of interleaved subchannel PW data.
 void subpw_deinterleave(const uint8 *in_buf, uint8 *out_buf)
 {
  assert(in_buf != out_buf);
 
- memset(out_buf, 0, 96);
-
- for(unsigned ch = 0; ch < 8; ch++)
+ for(unsigned d = 0; d < 12; d++)
  {
-  for(unsigned i = 0; i < 96; i++)
-  {
-   out_buf[(ch * 12) + (i >> 3)] |= ((in_buf[i] >> (7 - ch)) & 0x1) << (7 - (i & 0x7));
-  }
- }
+  const uint64 x = subpw_transpose8x8(MDFN_de64lsb(&in_buf[d << 3]));
 
+  for(unsigned ch = 0; ch < 8; ch++)
+   out_buf[ch * 12 + d] = x >> (ch << 3);
+ }
 }
 
 // Interleaves 96 bytes of subchannel P-W data from 96 bytes of uninterleaved subchannel PW data.
@@ -219,16 +234,12 @@ void subpw_interleave(const uint8 *in_buf, uint8 *out_buf)
 
  for(unsigned d = 0; d < 12; d++)
  {
-  for(unsigned bitpoodle = 0; bitpoodle < 8; bitpoodle++)
-  {
-   uint8 rawb = 0;
+  uint64 x = 0;
 
-   for(unsigned ch = 0; ch < 8; ch++)
-   {
-    rawb |= ((in_buf[ch * 12 + d] >> (7 - bitpoodle)) & 1) << (7 - ch);
-   }
-   out_buf[(d << 3) + bitpoodle] = rawb;
-  }
+  for(unsigned ch = 0; ch < 8; ch++)
+   x |= (uint64)in_buf[ch * 12 + d] << (ch << 3);
+
+  MDFN_en64lsb(&out_buf[d << 3], subpw_transpose8x8(x));
  }
 }
 
@@ -22,6 +22,12 @@
  */
 
 #include "dvdisaster.h"
+#include "mdfn_endian.h"
+
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+#include <immintrin.h>
+#define EDC_HAVE_CLMUL
+#endif
 
 /***
  *** EDC checksum used in CDROM sectors
@@ -117,9 +123,12 @@ unsigned long  edctable[256] =
 
 /*
  * CDROM EDC calculation
+ *
+ * Every implementation here gives the same result as the byte at a time
+ * table lookup, EDCCrc32() uses the fastest one the CPU supports.
  */
 
-uint32 EDCCrc32(const unsigned char *data, int len)
+uint32 EDCCrc32_Bytewise(const unsigned char *data, int len)
 {  
  uint32 crc = 0;
 
@@ -128,3 +137,160 @@ uint32 EDCCrc32(const unsigned char *data, int len)
 
  return crc;
 }
+
+/*
+ * Slicing-by-8: table[n][i] is the CRC of byte i followed by n zero bytes,
+ * so 8 bytes can be folded in with 8 independent lookups.
+ */
+
+static const class EDCSliceTable
+{
+ public:
+ uint32 table[8][256];
+
+ EDCSliceTable()
+ {
+  for(int i = 0; i < 256; i++)
+   table[0][i] = edctable[i];
+
+  for(int n = 1; n < 8; n++)
+   for(int i = 0; i < 256; i++)
+    table[n][i] = (table[n - 1][i] >> 8) ^ table[0][table[n - 1][i] & 0xFF];
+ }
+} EDC_SLICE;
+
+static uint32 EDCCrc32_Slice8_Update(uint32 crc, const unsigned char *data, int len)
+{
+ const uint32 (*t)[256] = EDC_SLICE.table;
+
+ while(len >= 8)
+ {
+  uint32 lo = MDFN_de32lsb(data) ^ crc;
+  uint32 hi = MDFN_de32lsb(data + 4);
+
+  crc = t[7][lo & 0xFF] ^ t[6][(lo >> 8) & 0xFF] ^ t[5][(lo >> 16) & 0xFF] ^ t[4][lo >> 24] ^
+	t[3][hi & 0xFF] ^ t[2][(hi >> 8) & 0xFF] ^ t[1][(hi >> 16) & 0xFF] ^ t[0][hi >> 24];
+
+  data += 8;
+  len -= 8;
+ }
+
+ while(len--)
+  crc = edctable[(crc ^ *data++) & 0xFF] ^ (crc >> 8);
+
+ return crc;
+}
+
+uint32 EDCCrc32_Slice8(const unsigned char *data, int len)
+{
+ return EDCCrc32_Slice8_Update(0, data, len);
+}
+
+#ifdef EDC_HAVE_CLMUL
+/*
+ * Carry-less multiply folding, as in Intel's "Fast CRC Computation for Generic
+ * Polynomials Using PCLMULQDQ Instruction", for the bit reflected EDC polynomial.
+ * Four 128 bit lanes are folded 512 bits forward at a time, then into one lane,
+ * which is left with the same CRC as the whole input and finished off by table.
+ *
+ * Each constant is x^n mod P(x), bit reflected and shifted left by one:
+ *  K1 = x^(512+32), K2 = x^(512-32), K3 = x^(128+32), K4 = x^(128-32)
+ */
+#define EDC_CLMUL_K1 0x1F8931102ULL
+#define EDC_CLMUL_K2 0x12E7928A2ULL
+#define EDC_CLMUL_K3 0x06C90C100ULL
+#define EDC_CLMUL_K4 0x1D5934102ULL
+
+__attribute__((target("pclmul,sse2")))
+static inline __m128i EDC_Fold(__m128i x, __m128i k, __m128i next)
+{
+ return _mm_xor_si128(_mm_xor_si128(_mm_clmulepi64_si128(x, k, 0x00), _mm_clmulepi64_si128(x, k, 0x11)), next);
+}
+
+__attribute__((target("pclmul,sse2")))
+uint32 EDCCrc32_CLMUL(const unsigned char *data, int len)
+{
+ if(len < 64)
+  return EDCCrc32_Slice8_Update(0, data, len);
+
+ const __m128i k1k2 = _mm_set_epi64x(EDC_CLMUL_K2, EDC_CLMUL_K1);
+ const __m128i k3k4 = _mm_set_epi64x(EDC_CLMUL_K4, EDC_CLMUL_K3);
+ __m128i x0 = _mm_loadu_si128((const __m128i*)(data + 0));
+ __m128i x1 = _mm_loadu_si128((const __m128i*)(data + 16));
+ __m128i x2 = _mm_loadu_si128((const __m128i*)(data + 32));
+ __m128i x3 = _mm_loadu_si128((const __m128i*)(data + 48));
+
+ data += 64;
+ len -= 64;
+
+ while(len >= 64)
+ {
+  x0 = EDC_Fold(x0, k1k2, _mm_loadu_si128((const __m128i*)(data + 0)));
+  x1 = EDC_Fold(x1, k1k2, _mm_loadu_si128((const __m128i*)(data + 16)));
+  x2 = EDC_Fold(x2, k1k2, _mm_loadu_si128((const __m128i*)(data + 32)));
+  x3 = EDC_Fold(x3, k1k2, _mm_loadu_si128((const __m128i*)(data + 48)));
+
+  data += 64;
+  len -= 64;
+ }
+
+ x0 = EDC_Fold(x0, k3k4, x1);
+ x0 = EDC_Fold(x0, k3k4, x2);
+ x0 = EDC_Fold(x0, k3k4, x3);
+
+ while(len >= 16)
+ {
+  x0 = EDC_Fold(x0, k3k4, _mm_loadu_si128((const __m128i*)data));
+
+  data += 16;
+  len -= 16;
+ }
+
+ uint8 folded[16];
+
+ _mm_storeu_si128((__m128i*)folded, x0);
+
+ return EDCCrc32_Slice8_Update(EDCCrc32_Slice8_Update(0, folded, 16), data, len);
+}
+#endif
+
+EDCCrc32Func EDCCrc32_Get(int impl)
+{
+ switch(impl)
+ {
+  case EDC_IMPL_BYTEWISE:
+	return EDCCrc32_Bytewise;
+
+  case EDC_IMPL_SLICE8:
+	return EDCCrc32_Slice8;
+
+#ifdef EDC_HAVE_CLMUL
+  case EDC_IMPL_CLMUL:
+	if(__builtin_cpu_supports("pclmul"))
+	 return EDCCrc32_CLMUL;
+	break;
+#endif
+ }
+
+ return NULL;
+}
+
+static EDCCrc32Func EDCCrc32_Select(void)
+{
+ EDCCrc32Func best = NULL;
+
+ for(int impl = 0; impl < EDC_IMPL_COUNT; impl++)
+ {
+  if(EDCCrc32_Get(impl))
+   best = EDCCrc32_Get(impl);
+ }
+
+ return best;
+}
+
+uint32 EDCCrc32(const unsigned char *data, int len)
+{
+ static const EDCCrc32Func impl = EDCCrc32_Select();
+
+ return impl(data, len);
+}
@@ -62,6 +62,21 @@ void Verify(void);
 
 uint32 EDCCrc32(const unsigned char*, int);
 
+/* The implementations EDCCrc32() picks from, in order of preference(last is best) */
+
+enum
+{
+ EDC_IMPL_BYTEWISE,
+ EDC_IMPL_SLICE8,
+ EDC_IMPL_CLMUL,
+ EDC_IMPL_COUNT
+};
+
+typedef uint32 (*EDCCrc32Func)(const unsigned char*, int);
+
+/* NULL if the CPU(or compiler) doesn't support it */
+EDCCrc32Func EDCCrc32_Get(int impl);
+
 /***
  *** galois.c
  ***
@@ -25,6 +25,12 @@
 #include <sys/types.h>
 
 #include "lec.h"
+#include "dvdisaster.h"
+
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+#include <immintrin.h>
+#define LEC_HAVE_PSHUFB
+#endif
 
 #define GF8_PRIM_POLY 0x11d /* x^8 + x^4 + x^3 + x^2 + 1 */
 
@@ -51,22 +57,18 @@ static gf8_t GF8_ILOG[256];
 static const class Gf8_Q_Coeffs_Results_01 {
 private:
   u_int16_t table[43][256];
+  u_int8_t nibbles[43][2][2][16];
 public:
   Gf8_Q_Coeffs_Results_01();
   ~Gf8_Q_Coeffs_Results_01() {}
   const u_int16_t *operator[] (int i) const { return &table[i][0]; }
   operator const u_int16_t *() const	    { return &table[0][0]; }
-} CF8_Q_COEFFS_RESULTS_01;
 
-static const class CrcTable {
-private:
-  u_int32_t table[256];
-public:
-  CrcTable();
-  ~CrcTable() {}
-  u_int32_t operator[](int i) const	{ return table[i]; }
-  operator const u_int32_t *() const	{ return table;    }
-} CRCTABLE;
+  /* The products of Q coefficient 'i' of parity byte 'p' with the low
+   * (half 0) and high (half 1) nibbles 0..15, for pshufb lookups.
+   */
+  const u_int8_t *nibble(int i, int p, int half) const { return nibbles[i][p][half]; }
+} CF8_Q_COEFFS_RESULTS_01;
 
 static const class ScrambleTable {
 private:
@@ -221,69 +223,26 @@ Gf8_Q_Coeffs_Results_01::Gf8_Q_Coeffs_Results_01()
       table[j][i] |= GF8_ILOG[c]<<8;
     }
   }
-}
-
-/* Reverses the bits in 'd'. 'bits' defines the bit width of 'd'.
- */
-static u_int32_t mirror_bits(u_int32_t d, int bits)
-{
-  int i;
-  u_int32_t r = 0;
-
-  for (i = 0; i < bits; i++) {
-    r <<= 1;
-
-    if ((d & 0x1) != 0)
-      r |= 0x1;
-
-    d >>= 1;
-  }
-
-  return r;
-}
-
-/* Build the CRC lookup table for EDC_POLY poly. The CRC is 32 bit wide
- * and reversed (i.e. the bit stream is divided by the EDC_POLY with the
- * LSB first order).
- */
-CrcTable::CrcTable ()
-{
-  u_int32_t i, j;
-  u_int32_t r;
-  
-  for (i = 0; i < 256; i++) {
-    r = mirror_bits(i, 8);
-
-    r <<= 24;
 
-    for (j = 0; j < 8; j++) {
-      if ((r & 0x80000000) != 0) {
-	r <<= 1;
-	r ^= EDC_POLY;
-      }
-      else {
-	r <<= 1;
-      }
+  /* Multiplication by a constant is linear, so a product is the XOR of
+   * the products with the low and the high nibble of the operand.
+   */
+  for (j = 0; j < 43; j++) {
+    for (i = 0; i < 16; i++) {
+      nibbles[j][0][0][i] = table[j][i] & 0xff;
+      nibbles[j][0][1][i] = table[j][i << 4] & 0xff;
+      nibbles[j][1][0][i] = table[j][i] >> 8;
+      nibbles[j][1][1][i] = table[j][i << 4] >> 8;
     }
-
-    r = mirror_bits(r, 32);
-
-    table[i] = r;
   }
 }
 
-/* Calculates the CRC of given data with given lengths based on the
- * table lookup algorithm.
+/* Calculates the CRC of given data with given lengths, with the fastest
+ * EDCCrc32() implementation the CPU supports.
  */
 static u_int32_t calc_edc(u_int8_t *data, int len)
 {
-  u_int32_t crc = 0;
-
-  while (len--) {
-    crc = CRCTABLE[(int)(crc ^ *data++) & 0xff] ^ (crc >> 8);
-  }
-
-  return crc;
+  return EDCCrc32(data, len);
 }
 
 /* Build the scramble table as defined in the yellow book. The bytes
@@ -478,6 +437,230 @@ static void calc_Q_parity(u_int8_t *sector)
   }
 }
 
+static void calc_PQ_parity_scalar(u_int8_t *sector)
+{
+  calc_P_parity(sector);
+  calc_Q_parity(sector);
+}
+
+#ifdef LEC_HAVE_PSHUFB
+
+/* The vector versions compute all byte columns of the parity vectors at
+ * once. 'rows[r]' holds byte column 0..len-1 of every vector, to be
+ * multiplied with Q coefficient 'coeff + r'. The two parity bytes of each
+ * column go to 'out0' and 'out1'. A length that is not a multiple of the
+ * vector width is finished by an overlapping last chunk, which stores the
+ * same values again.
+ */
+__attribute__((target("ssse3")))
+static void gf8_parity_ssse3(const u_int8_t *const *rows, int count, int coeff, int len,
+			     u_int8_t *out0, u_int8_t *out1)
+{
+  const __m128i mask = _mm_set1_epi8(0x0f);
+  int offset = 0;
+
+  for (;;) {
+    __m128i acc0 = _mm_setzero_si128();
+    __m128i acc1 = _mm_setzero_si128();
+
+    for (int r = 0; r < count; r++) {
+      __m128i d = _mm_loadu_si128((const __m128i *)(rows[r] + offset));
+      __m128i lo = _mm_and_si128(d, mask);
+      __m128i hi = _mm_and_si128(_mm_srli_epi16(d, 4), mask);
+
+      acc0 = _mm_xor_si128(acc0, _mm_shuffle_epi8(_mm_loadu_si128((const __m128i *)CF8_Q_COEFFS_RESULTS_01.nibble(coeff + r, 0, 0)), lo));
+      acc0 = _mm_xor_si128(acc0, _mm_shuffle_epi8(_mm_loadu_si128((const __m128i *)CF8_Q_COEFFS_RESULTS_01.nibble(coeff + r, 0, 1)), hi));
+      acc1 = _mm_xor_si128(acc1, _mm_shuffle_epi8(_mm_loadu_si128((const __m128i *)CF8_Q_COEFFS_RESULTS_01.nibble(coeff + r, 1, 0)), lo));
+      acc1 = _mm_xor_si128(acc1, _mm_shuffle_epi8(_mm_loadu_si128((const __m128i *)CF8_Q_COEFFS_RESULTS_01.nibble(coeff + r, 1, 1)), hi));
+    }
+
+    _mm_storeu_si128((__m128i *)(out0 + offset), acc0);
+    _mm_storeu_si128((__m128i *)(out1 + offset), acc1);
+
+    if (offset == len - 16)
+      break;
+
+    offset += 16;
+    if (offset > len - 16)
+      offset = len - 16;
+  }
+}
+
+__attribute__((target("avx2")))
+static void gf8_parity_avx2(const u_int8_t *const *rows, int count, int coeff, int len,
+			    u_int8_t *out0, u_int8_t *out1)
+{
+  const __m256i mask = _mm256_set1_epi8(0x0f);
+  int offset = 0;
+
+  for (;;) {
+    __m256i acc0 = _mm256_setzero_si256();
+    __m256i acc1 = _mm256_setzero_si256();
+
+    for (int r = 0; r < count; r++) {
+      __m256i d = _mm256_loadu_si256((const __m256i *)(rows[r] + offset));
+      __m256i lo = _mm256_and_si256(d, mask);
+      __m256i hi = _mm256_and_si256(_mm256_srli_epi16(d, 4), mask);
+
+      acc0 = _mm256_xor_si256(acc0, _mm256_shuffle_epi8(_mm256_broadcastsi128_si256(_mm_loadu_si128((const __m128i *)CF8_Q_COEFFS_RESULTS_01.nibble(coeff + r, 0, 0))), lo));
+      acc0 = _mm256_xor_si256(acc0, _mm256_shuffle_epi8(_mm256_broadcastsi128_si256(_mm_loadu_si128((const __m128i *)CF8_Q_COEFFS_RESULTS_01.nibble(coeff + r, 0, 1))), hi));
+      acc1 = _mm256_xor_si256(acc1, _mm256_shuffle_epi8(_mm256_broadcastsi128_si256(_mm_loadu_si128((const __m128i *)CF8_Q_COEFFS_RESULTS_01.nibble(coeff + r, 1, 0))), lo));
+      acc1 = _mm256_xor_si256(acc1, _mm256_shuffle_epi8(_mm256_broadcastsi128_si256(_mm_loadu_si128((const __m128i *)CF8_Q_COEFFS_RESULTS_01.nibble(coeff + r, 1, 1))), hi));
+    }
+
+    _mm256_storeu_si256((__m256i *)(out0 + offset), acc0);
+    _mm256_storeu_si256((__m256i *)(out1 + offset), acc1);
+
+    if (offset == len - 32)
+      break;
+
+    offset += 32;
+    if (offset > len - 32)
+      offset = len - 32;
+  }
+}
+
+/* Transposes the 26 rows of 43 words the Q vectors are taken from into
+ * 'columns', in blocks of 8x8 words. Every column is stored twice in a
+ * row, so any rotation of it can be read contiguously.
+ * The last row block only has 2 rows, so the blocks go from the bottom up
+ * to let the second copy of the first block overwrite the 6 empty rows.
+ * The loads of the last column block run 5 words into the next row, which
+ * only ends up in the unused columns 43..47.
+ */
+__attribute__((target("sse2")))
+static void gf8_transpose_Q_words(const u_int8_t *words, u_int8_t (*columns)[2 * 64])
+{
+  for (int row = 24; row >= 0; row -= 8) {
+    for (int col = 0; col < 43; col += 8) {
+      __m128i r[8], a[8], b[8];
+
+      for (int i = 0; i < 8; i++) {
+	if (row + i < 26)
+	  r[i] = _mm_loadu_si128((const __m128i *)(words + 2 * (43 * (row + i) + col)));
+	else
+	  r[i] = _mm_setzero_si128();
+      }
+
+      for (int i = 0; i < 8; i += 2) {
+	a[i] = _mm_unpacklo_epi16(r[i], r[i + 1]);
+	a[i + 1] = _mm_unpackhi_epi16(r[i], r[i + 1]);
+      }
+
+      for (int i = 0; i < 8; i += 4) {
+	b[i] = _mm_unpacklo_epi32(a[i], a[i + 2]);
+	b[i + 1] = _mm_unpackhi_epi32(a[i], a[i + 2]);
+	b[i + 2] = _mm_unpacklo_epi32(a[i + 1], a[i + 3]);
+	b[i + 3] = _mm_unpackhi_epi32(a[i + 1], a[i + 3]);
+      }
+
+      for (int i = 0; i < 8; i++) {
+	__m128i column = (i & 1) ? _mm_unpackhi_epi64(b[i / 2], b[i / 2 + 4]) : _mm_unpacklo_epi64(b[i / 2], b[i / 2 + 4]);
+
+	_mm_storeu_si128((__m128i *)(columns[col + i] + 2 * row), column);
+	_mm_storeu_si128((__m128i *)(columns[col + i] + 2 * (26 + row)), column);
+      }
+    }
+  }
+}
+
+/* The 24 rows of 43 P vector words are contiguous in the sector, and
+ * use Q coefficients 19..42.
+ * A Q vector runs diagonally: word 'j' of Q vector 'i' is in row
+ * (i + j) % 26 and column 'j' of the 26 rows of 43 words. So word 'j' of
+ * all of the Q vectors is column 'j' rotated by j % 26 words.
+ */
+static void calc_PQ_parity_vector(u_int8_t *sector,
+				  void (*kernel)(const u_int8_t *const *, int, int, int, u_int8_t *, u_int8_t *))
+{
+  u_int8_t columns[48][2 * 64];
+  const u_int8_t *rows[43];
+  int i;
+
+  for (i = 0; i < 24; i++)
+    rows[i] = sector + LEC_HEADER_OFFSET + 2 * 43 * i;
+
+  kernel(rows, 24, 19, 2 * 43,
+	 sector + LEC_MODE1_P_PARITY_OFFSET + 2 * 43, sector + LEC_MODE1_P_PARITY_OFFSET);
+
+  gf8_transpose_Q_words(sector + LEC_HEADER_OFFSET, columns);
+
+  for (i = 0; i < 43; i++)
+    rows[i] = columns[i] + 2 * (i % 26);
+
+  kernel(rows, 43, 0, 2 * 26,
+	 sector + LEC_MODE1_Q_PARITY_OFFSET + 2 * 26, sector + LEC_MODE1_Q_PARITY_OFFSET);
+}
+
+static void calc_PQ_parity_ssse3(u_int8_t *sector)
+{
+  calc_PQ_parity_vector(sector, gf8_parity_ssse3);
+}
+
+static void calc_PQ_parity_avx2(u_int8_t *sector)
+{
+  calc_PQ_parity_vector(sector, gf8_parity_avx2);
+}
+
+#endif
+
+typedef void (*calc_PQ_parity_func)(u_int8_t *);
+
+static calc_PQ_parity_func calc_PQ_parity_get(int impl)
+{
+  switch (impl) {
+  case LEC_PARITY_SCALAR:
+    return calc_PQ_parity_scalar;
+
+#ifdef LEC_HAVE_PSHUFB
+  case LEC_PARITY_SSSE3:
+    if (__builtin_cpu_supports("ssse3"))
+      return calc_PQ_parity_ssse3;
+    break;
+
+  case LEC_PARITY_AVX2:
+    if (__builtin_cpu_supports("avx2"))
+      return calc_PQ_parity_avx2;
+    break;
+#endif
+  }
+
+  return NULL;
+}
+
+static calc_PQ_parity_func calc_PQ_parity_select()
+{
+  calc_PQ_parity_func best = NULL;
+
+  for (int impl = 0; impl < LEC_PARITY_COUNT; impl++) {
+    if (calc_PQ_parity_get(impl))
+      best = calc_PQ_parity_get(impl);
+  }
+
+  return best;
+}
+
+/* Calculates the P and Q parities with the fastest implementation the
+ * CPU supports.
+ */
+static void calc_PQ_parity(u_int8_t *sector)
+{
+  static const calc_PQ_parity_func impl = calc_PQ_parity_select();
+
+  impl(sector);
+}
+
+int lec_calc_PQ_parity(int impl, u_int8_t *sector)
+{
+  calc_PQ_parity_func func = calc_PQ_parity_get(impl);
+
+  if (!func)
+    return 0;
+
+  func(sector);
+  return 1;
+}
+
 /* Encodes a MODE 0 sector.
  * 'adr' is the current physical sector address
  * 'sector' must be 2352 byte wide
@@ -517,8 +700,7 @@ void lec_encode_mode1_sector(u_int32_t adr, u_int8_t *sector)
     sector[LEC_MODE1_INTERMEDIATE_OFFSET + 6] =
     sector[LEC_MODE1_INTERMEDIATE_OFFSET + 7] = 0;
 
-  calc_P_parity(sector);
-  calc_Q_parity(sector);
+  calc_PQ_parity(sector);
 }
 
 /* Encodes a MODE 2 sector.
@@ -549,8 +731,7 @@ void lec_encode_mode2_form1_sector(u_int32_t adr, u_int8_t *sector)
     sector[LEC_HEADER_OFFSET + 2] =
     sector[LEC_HEADER_OFFSET + 3] = 0;
 
-  calc_P_parity(sector);
-  calc_Q_parity(sector);
+  calc_PQ_parity(sector);
   
   /* finally add the sector header */
   set_sector_header(2, adr, sector);
@@ -74,4 +74,19 @@ void lec_encode_mode2_form2_sector(u_int32_t adr, u_int8_t *sector);
  */
 void lec_scramble(u_int8_t *sector);
 
+/* The P/Q parity implementations, in order of preference(last is best) */
+enum
+{
+  LEC_PARITY_SCALAR,
+  LEC_PARITY_SSSE3,
+  LEC_PARITY_AVX2,
+  LEC_PARITY_COUNT
+};
+
+/* Calculates the P and Q parities of a MODE 1 or XA form 1 sector with
+ * the given implementation.
+ * Returns 0 if the CPU does not support it.
+ */
+int lec_calc_PQ_parity(int impl, u_int8_t *sector);
+
 #endif
@@ -153,6 +153,11 @@ void Stream::unmap(void) noexcept
 
 }
 
+void Stream::preload(void) noexcept
+{
+
+}
+
 void Stream::put_line(const std::string& str)
 {
  char l = '\n';
@@ -52,6 +52,12 @@ class Stream
 				// If the data can't be "unmapped" as such because it was never mmap()'d or similar in the first place(such as with MemoryStream),
 				// then this will be a nop.
 
+ virtual void preload(void) noexcept;
+				// Make the data returned by map() resident(and backed by huge pages where the system allows it), so later accesses
+				// don't fault.  Safe to call while other threads read through the mapping.
+				//
+				// A nop if there is no mapping.
+
  virtual uint64 read(void *data, uint64 count, bool error_on_eos = true) = 0;
  virtual void write(const void *data, uint64 count) = 0;
 
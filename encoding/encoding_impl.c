@@ -10,6 +10,8 @@
 #include "alloc.h"
 #include "fatal_error.h"
 #include "encoding_impl.h"
+#include "perf.h"
+#include "trace.h"
 
 #define MAX_SAMPLES 2048
 
@@ -118,6 +120,7 @@ static void encoding_impl_process_packets(AVFormatContext* output_format, AVPack
 }
 
 static int encoding_impl_worker_thread(void* arg) {
+	TRACE_THREAD_NAME("encoder");
 	encoding_impl_t* impl = arg;
 	encoding_impl_av_frame_t* av_frame = impl->frames;
 	uint32_t pos = 0;
@@ -130,20 +133,27 @@ static int encoding_impl_worker_thread(void* arg) {
 		}
 
 		mtx_lock(&av_frame->lock);
+		PERF_ENTER(perf_resume, PERF_STAGE_ENCODING);
 
+		TRACE_BEGIN(trace_video);
 		err = avcodec_send_frame(impl->video.codec, av_frame->video);
 		if (err) {
 			FATAL_AV_ERROR("Error while encoding video", err);
 		}
 
 		encoding_impl_process_packets(impl->output_format, impl->packet, &impl->video);
+		TRACE_END("encode_video", trace_video);
 
+		TRACE_BEGIN(trace_audio);
 		err = avcodec_send_frame(impl->audio.codec, av_frame->audio);
 		if (err) {
 			FATAL_AV_ERROR("Error while encoding audio", err);
 		}
 
 		encoding_impl_process_packets(impl->output_format, impl->packet, &impl->audio);
+		TRACE_END("encode_audio", trace_audio);
+
+		PERF_LEAVE(perf_resume);
 
 		atomic_store_explicit(&av_frame->active, false, memory_order_relaxed);
 		mtx_unlock(&av_frame->lock);
@@ -366,6 +376,27 @@ void encoding_impl_destroy(encoding_impl_t* impl) {
 	free(impl);
 }
 
+static void encoding_impl_scale(encoding_impl_t* impl, void* video, uint32_t pitch, AVFrame* dst) {
+	impl->prescaled_frame->data[0] = video;
+	impl->prescaled_frame->linesize[0] = pitch;
+	TRACE_BEGIN(trace_scale);
+	PERF_ENTER(perf_resume, PERF_STAGE_SCALING);
+	sws_scale(impl->sws, (void*)impl->prescaled_frame->data, impl->prescaled_frame->linesize, 0, impl->height, dst->data, dst->linesize);
+	PERF_LEAVE(perf_resume);
+	TRACE_END("sws_scale", trace_scale);
+}
+
+void encoding_impl_scale_frame(encoding_impl_t* impl, void* video, uint32_t pitch) {
+	encoding_impl_av_frame_t* av_frame = &impl->frames[impl->position];
+	while (atomic_load_explicit(&av_frame->active, memory_order_relaxed)) {
+		thrd_sleep(&encoding_impl_sleep_dur, NULL);
+	}
+
+	mtx_lock(&av_frame->lock);
+	encoding_impl_scale(impl, video, pitch, av_frame->video);
+	mtx_unlock(&av_frame->lock);
+}
+
 void encoding_impl_push_frame(encoding_impl_t* impl, void* video, uint32_t pitch, void* audio, uint32_t num_samples) {
 	if (num_samples > MAX_SAMPLES) {
 		FATAL_ERROR("Too many samples! Maximum is %d, got %d", MAX_SAMPLES, num_samples);
@@ -373,15 +404,15 @@ void encoding_impl_push_frame(encoding_impl_t* impl, void* video, uint32_t pitch
 
 	encoding_impl_av_frame_t* av_frame = &impl->frames[impl->position];
 
+	TRACE_BEGIN(trace_wait);
 	while (atomic_load_explicit(&av_frame->active, memory_order_relaxed)) {
 		thrd_sleep(&encoding_impl_sleep_dur, NULL);
 	}
+	TRACE_END("wait_for_encoder", trace_wait);
 
 	mtx_lock(&av_frame->lock);
 
-	impl->prescaled_frame->data[0] = video;
-	impl->prescaled_frame->linesize[0] = pitch;
-	sws_scale(impl->sws, (void*)impl->prescaled_frame->data, impl->prescaled_frame->linesize, 0, impl->height, av_frame->video->data, av_frame->video->linesize);
+	encoding_impl_scale(impl, video, pitch, av_frame->video);
 	av_frame->video->pts = av_rescale_q(impl->abs_sample_ts, encoding_impl_audio_rate, impl->video.codec->time_base);
 
 	memcpy(av_frame->audio->data[0], audio, num_samples * 2 * sizeof(int16_t));
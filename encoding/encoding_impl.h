@@ -8,5 +8,7 @@ encoding_impl_t* encoding_impl_create(const char* path, const char* extension, c
 	uint32_t bitrate_kbps, uint32_t width, uint32_t height, uint32_t fps_num, uint32_t fps_den, uint32_t frames_to_buffer);
 void encoding_impl_destroy(encoding_impl_t* impl);
 void encoding_impl_push_frame(encoding_impl_t* impl, void* video, uint32_t pitch, void* audio, uint32_t num_samples);
+// scales the video into the next frame like push_frame does, but doesn't queue it for encoding (for benchmarking the scaler alone)
+void encoding_impl_scale_frame(encoding_impl_t* impl, void* video, uint32_t pitch);
 
 #endif
@@ -1,26 +1,38 @@
+#define _POSIX_C_SOURCE 200809L
+#include <unistd.h>
+
 #include "alloc.h"
 #include "fatal_error.h"
 #include "stub.h"
 #include "gpgx_api.h"
 #include "core.h"
-
-typedef struct {
-	core_t core;
-	wbx_impl_t* wbx;
-	gpgx_api_t* api;
-	core_file_t* rom;
-	disc_impl_t* disc;
-	gpgx_api_cd_data_t* toc;
-	core_file_t* firmware;
-	void* load_archive_cb_stub;
-	gpgx_api_load_archive_cb_t load_archive_cb;
-	void* cd_read_cb_stub;
-	gpgx_api_cd_read_cb_t cd_read_cb;
-	uint32_t* video_buffer;
-	uint32_t video_buffer_size;
-	int16_t* audio_buffer;
-	uint32_t audio_buffer_size;
-} gpgx_impl_t;
+#include "gpgx_impl.h"
+#include "perf.h"
+#include "trace.h"
+
+#define GPGX_IMPL_MAX_MEMDOMS 16
+#define GPGX_IMPL_BUS_SIZE 0x1000000
+
+// profiling mode, profiles every core from init until it's destroyed
+#ifdef SLIMHAWK_PROFILE
+#define GPGX_IMPL_PROFILE_SAMPLE_EVERY 97 // instructions per sample (odd, so it doesn't lock onto loops), 0 for timer only
+#define GPGX_IMPL_PROFILE_TIMER_HZ 0 // samples per second of CPU time, 0 for none
+#define GPGX_IMPL_PROFILE_FRAME_INTERVAL 1
+#endif
+
+static const profiler_region_t gpgx_impl_cd_regions[] = {
+	{ 0x000000, 0x020000, "BIOS" },
+	{ 0x020000, 0x040000, "PRG RAM" },
+	{ 0x200000, 0x240000, "WORD RAM" },
+	{ 0xA00000, 0xA10000, "Z80" },
+	{ 0xE00000, 0x1000000, "68K RAM" },
+};
+
+static const profiler_region_t gpgx_impl_cart_regions[] = {
+	{ 0x000000, 0x400000, "ROM" },
+	{ 0xA00000, 0xA10000, "Z80" },
+	{ 0xE00000, 0x1000000, "68K RAM" },
+};
 
 WBX_CALL static int32_t gpgx_impl_load_archive_callback(const char* filename, void* buffer, uint32_t max_size, void* userdata) {
 	if (!buffer) {
@@ -85,6 +97,8 @@ WBX_CALL static int32_t gpgx_impl_load_archive_callback(const char* filename, vo
 
 WBX_CALL static void gpgx_impl_cd_read_callback(int32_t lba, void* dst, bool audio, void* userdata) {
 	gpgx_impl_t* impl = (gpgx_impl_t*)userdata;
+	TRACE_BEGIN(trace_start);
+	PERF_ENTER(perf_resume, PERF_STAGE_DISC_READ);
 	if (audio) {
 		if (lba < impl->toc->end) {
 			disc_impl_read_lba_2352(impl->disc, lba, dst);
@@ -94,6 +108,56 @@ WBX_CALL static void gpgx_impl_cd_read_callback(int32_t lba, void* dst, bool aud
 	} else {
 		disc_impl_read_lba_2048(impl->disc, lba, dst);
 	}
+	PERF_LEAVE(perf_resume);
+	TRACE_END("cd_read", trace_start);
+}
+
+WBX_CALL static void gpgx_impl_input_callback(void* userdata) {
+	gpgx_impl_t* impl = (gpgx_impl_t*)userdata;
+	impl->polls++;
+}
+
+// non-matching accesses should leave as fast as possible
+static inline void gpgx_impl_mem_callback(gpgx_impl_t* impl, gpgx_impl_watch_kind_t kind, uint32_t addr) {
+	addr &= GPGX_IMPL_BUS_SIZE - 1;
+	if (__builtin_expect(!(impl->watch_bitmaps[kind][addr >> 3] & (1 << (addr & 7))), true)) {
+		return;
+	}
+
+	impl->watch_hits[kind]++;
+}
+
+WBX_CALL static void gpgx_impl_read_callback(uint32_t addr, void* userdata) {
+	gpgx_impl_mem_callback(userdata, GPGX_IMPL_WATCH_READ, addr);
+}
+
+WBX_CALL static void gpgx_impl_write_callback(uint32_t addr, void* userdata) {
+	gpgx_impl_mem_callback(userdata, GPGX_IMPL_WATCH_WRITE, addr);
+}
+
+// shared by the profiler, so either may have registered it
+WBX_CALL static void gpgx_impl_exec_callback(uint32_t addr, void* userdata) {
+	gpgx_impl_t* impl = (gpgx_impl_t*)userdata;
+	if (impl->profiling) {
+		profiler_sample(impl->profiler, addr);
+	}
+
+	if (impl->watching[GPGX_IMPL_WATCH_EXEC]) {
+		gpgx_impl_mem_callback(impl, GPGX_IMPL_WATCH_EXEC, addr);
+	}
+}
+
+static void gpgx_impl_update_mem_callbacks(gpgx_impl_t* impl) {
+	gpgx_api_mem_cb_t cbs[GPGX_IMPL_WATCH_KINDS];
+	for (uint32_t i = 0; i < GPGX_IMPL_WATCH_KINDS; i++) {
+		cbs[i] = impl->watching[i] ? impl->mem_cbs[i] : NULL;
+	}
+
+	if (impl->profiling) {
+		cbs[GPGX_IMPL_WATCH_EXEC] = impl->mem_cbs[GPGX_IMPL_WATCH_EXEC];
+	}
+
+	impl->api->gpgx_set_mem_callback(cbs[GPGX_IMPL_WATCH_READ], cbs[GPGX_IMPL_WATCH_WRITE], cbs[GPGX_IMPL_WATCH_EXEC]);
 }
 
 static void gpgx_impl_init(core_t* core, core_files_t* files) {
@@ -103,13 +167,25 @@ static void gpgx_impl_init(core_t* core, core_files_t* files) {
 	// create callback stubs
 	impl->load_archive_cb_stub = stub_create(gpgx_impl_load_archive_callback, impl, 3);
 	impl->cd_read_cb_stub = stub_create(gpgx_impl_cd_read_callback, impl, 3);
+	impl->input_cb_stub = stub_create(gpgx_impl_input_callback, impl, 0);
+	impl->mem_cb_stubs[GPGX_IMPL_WATCH_READ] = stub_create(gpgx_impl_read_callback, impl, 1);
+	impl->mem_cb_stubs[GPGX_IMPL_WATCH_WRITE] = stub_create(gpgx_impl_write_callback, impl, 1);
+	impl->mem_cb_stubs[GPGX_IMPL_WATCH_EXEC] = stub_create(gpgx_impl_exec_callback, impl, 1);
 
 	// register callbacks
 	wbx_impl_register_callback(impl->wbx, impl->load_archive_cb_stub);
 	wbx_impl_register_callback(impl->wbx, impl->cd_read_cb_stub);
+	wbx_impl_register_callback(impl->wbx, impl->input_cb_stub);
+	for (uint32_t i = 0; i < GPGX_IMPL_WATCH_KINDS; i++) {
+		wbx_impl_register_callback(impl->wbx, impl->mem_cb_stubs[i]);
+	}
 
 	impl->load_archive_cb = wbx_impl_get_callback_addr(impl->wbx, impl->load_archive_cb_stub);
 	impl->cd_read_cb = wbx_impl_get_callback_addr(impl->wbx, impl->cd_read_cb_stub);
+	impl->input_cb = wbx_impl_get_callback_addr(impl->wbx, impl->input_cb_stub);
+	for (uint32_t i = 0; i < GPGX_IMPL_WATCH_KINDS; i++) {
+		impl->mem_cbs[i] = wbx_impl_get_callback_addr(impl->wbx, impl->mem_cb_stubs[i]);
+	}
 
 	// default settings more or less
 	gpgx_api_init_settings_t settings;
@@ -160,24 +236,56 @@ static void gpgx_impl_init(core_t* core, core_files_t* files) {
 		FATAL_ERROR("gpgx_init failed!");
 	}
 
+	// cache 68K RAM, this pointer is stable for the lifetime of the core
+	int32_t size = 0;
+	const char* name = impl->api->gpgx_get_memdom(0, &impl->m68k_ram, &size);
+	if (!impl->m68k_ram || size != 0x10000 || !name || strcmp("68K RAM", name)) {
+		FATAL_ERROR("Interop error in gpgx_get_memdom");
+	}
+
+	if (!impl->api->gpgx_get_control(&impl->input, sizeof(gpgx_api_input_data_t))) {
+		FATAL_ERROR("Interop error in gpgx_get_control");
+	}
+
 	impl->api->gpgx_set_cdd_callback(NULL);
 	wbx_impl_seal(impl->wbx);
 	impl->api->gpgx_set_cdd_callback(impl->cd_read_cb);
+	impl->api->gpgx_set_input_callback(impl->input_cb);
+#ifdef SLIMHAWK_PROFILE
+	gpgx_impl_start_profiler(core, GPGX_IMPL_PROFILE_SAMPLE_EVERY, GPGX_IMPL_PROFILE_TIMER_HZ, GPGX_IMPL_PROFILE_FRAME_INTERVAL);
+#endif
 	wbx_impl_exit(impl->wbx);
 }
 
 static void gpgx_impl_destroy(core_t* core) {
 	gpgx_impl_t* impl = (gpgx_impl_t*)core;
+	if (impl->profiler) {
+		// search workers profile too, so keep each process's output separate
+		char report_path[64], collapsed_path[64];
+		snprintf(report_path, sizeof(report_path), "profile_%d.txt", getpid());
+		snprintf(collapsed_path, sizeof(collapsed_path), "profile_%d.folded", getpid());
+		gpgx_impl_stop_profiler(core, report_path, collapsed_path);
+	}
+
 	wbx_impl_destroy(impl->wbx);
 	free(impl->api);
 	free(impl->rom);
 	if (impl->disc) {
+#ifdef SLIMHAWK_PERF
+		// printed alongside the perf counters, every other build (and every search worker) stays quiet
+		disc_impl_print_stats(impl->disc);
+#endif
 		disc_impl_destroy(impl->disc);
 	}
 	free(impl->toc);
 	free(impl->firmware);
 	stub_destroy(impl->load_archive_cb_stub);
 	stub_destroy(impl->cd_read_cb_stub);
+	stub_destroy(impl->input_cb_stub);
+	for (uint32_t i = 0; i < GPGX_IMPL_WATCH_KINDS; i++) {
+		stub_destroy(impl->mem_cb_stubs[i]);
+		free(impl->watch_bitmaps[i]);
+	}
 	free(impl->video_buffer);
 	free(impl->audio_buffer);
 	free(impl);
@@ -215,6 +323,143 @@ static void gpgx_impl_poke_byte(core_t* core, uint32_t addr, uint8_t val) {
 	(void)val;
 }
 
+uint8_t* gpgx_impl_get_memdom(core_t* core, const char* name, uint32_t* size) {
+	gpgx_impl_t* impl = (gpgx_impl_t*)core;
+	for (int32_t i = 0; i < GPGX_IMPL_MAX_MEMDOMS; i++) {
+		uint8_t* area = NULL;
+		int32_t area_size = 0;
+		const char* area_name = impl->api->gpgx_get_memdom(i, &area, &area_size);
+		if (area_name && area && area_size > 0 && strstr(area_name, name)) {
+			*size = area_size;
+			return area;
+		}
+	}
+
+	return NULL;
+}
+
+void* gpgx_impl_save_state(core_t* core, uintptr_t* length) {
+	gpgx_impl_t* impl = (gpgx_impl_t*)core;
+	TRACE_BEGIN(trace_start);
+	void* state = wbx_impl_save_state(impl->wbx, length);
+	TRACE_END("save_state", trace_start);
+	return state;
+}
+
+void gpgx_impl_load_state(core_t* core, void* data, uintptr_t length) {
+	gpgx_impl_t* impl = (gpgx_impl_t*)core;
+	TRACE_BEGIN(trace_start);
+	wbx_impl_load_state(impl->wbx, data, length);
+	impl->api->gpgx_set_cdd_callback(impl->cd_read_cb);
+	impl->api->gpgx_set_input_callback(impl->input_cb);
+	gpgx_impl_update_mem_callbacks(impl);
+	impl->api->gpgx_invalidate_pattern_cache();
+	// the state has its own control input, which run_until checks impl->input against before putting a new pad
+	if (!impl->api->gpgx_get_control(&impl->input, sizeof(gpgx_api_input_data_t))) {
+		FATAL_ERROR("Interop error in gpgx_get_control");
+	}
+	TRACE_END("load_state", trace_start);
+}
+
+trigger_t* gpgx_impl_compile_trigger(core_t* core, const char* expr) {
+	gpgx_impl_t* impl = (gpgx_impl_t*)core;
+	return trigger_compile(expr, impl->m68k_ram, 0x10000, true);
+}
+
+void gpgx_impl_watch(core_t* core, gpgx_impl_watch_kind_t kind, uint32_t addr, uint32_t size) {
+	gpgx_impl_t* impl = (gpgx_impl_t*)core;
+	if (!impl->watch_bitmaps[kind]) {
+		impl->watch_bitmaps[kind] = zalloc(GPGX_IMPL_BUS_SIZE / 8);
+	}
+
+	// the range is clamped to the bus rather than wrapping around to address 0
+	uint64_t end = (uint64_t)addr + size;
+	if (end > GPGX_IMPL_BUS_SIZE) {
+		end = GPGX_IMPL_BUS_SIZE;
+	}
+
+	for (uint32_t a = addr; a < end; a++) {
+		impl->watch_bitmaps[kind][a >> 3] |= 1 << (a & 7);
+	}
+
+	if (!impl->watching[kind]) {
+		impl->watching[kind] = true;
+		gpgx_impl_update_mem_callbacks(impl);
+	}
+}
+
+void gpgx_impl_unwatch(core_t* core, gpgx_impl_watch_kind_t kind) {
+	gpgx_impl_t* impl = (gpgx_impl_t*)core;
+	if (impl->watching[kind]) {
+		memset(impl->watch_bitmaps[kind], 0, GPGX_IMPL_BUS_SIZE / 8);
+		impl->watching[kind] = false;
+		gpgx_impl_update_mem_callbacks(impl);
+	}
+}
+
+void gpgx_impl_start_profiler(core_t* core, uint32_t sample_every, uint32_t timer_hz, uint32_t frame_interval) {
+	gpgx_impl_t* impl = (gpgx_impl_t*)core;
+	if (impl->profiler) {
+		FATAL_ERROR("Profiler is already running");
+	}
+
+	if (impl->disc) {
+		impl->profiler = profiler_create(sample_every, timer_hz, gpgx_impl_cd_regions, sizeof(gpgx_impl_cd_regions) / sizeof(profiler_region_t));
+	} else {
+		impl->profiler = profiler_create(sample_every, timer_hz, gpgx_impl_cart_regions, sizeof(gpgx_impl_cart_regions) / sizeof(profiler_region_t));
+	}
+
+	// the exec callback is registered by the next frame advance
+	impl->profile_frame_interval = frame_interval ? frame_interval : 1;
+	impl->profile_frame = 0;
+}
+
+void gpgx_impl_stop_profiler(core_t* core, const char* report_path, const char* collapsed_path) {
+	gpgx_impl_t* impl = (gpgx_impl_t*)core;
+	if (impl->profiling) {
+		impl->profiling = false;
+		gpgx_impl_update_mem_callbacks(impl);
+	}
+
+	profiler_write(impl->profiler, report_path, collapsed_path);
+	profiler_destroy(impl->profiler);
+	impl->profiler = NULL;
+}
+
+void gpgx_impl_profile_frame(core_t* core) {
+	gpgx_impl_t* impl = (gpgx_impl_t*)core;
+	bool profiling = impl->profile_frame++ % impl->profile_frame_interval == 0;
+	if (profiling != impl->profiling) {
+		impl->profiling = profiling;
+		gpgx_impl_update_mem_callbacks(impl);
+	}
+}
+
+uint32_t gpgx_impl_run_until(core_t* core, trigger_t* condition, trigger_t* input_policy, uint32_t max_frames, gpgx_impl_frame_cb_t frame_cb, void* userdata) {
+	gpgx_impl_t* impl = (gpgx_impl_t*)core;
+	uint32_t frames = 0;
+	while (frames < max_frames && !(condition && trigger_eval(condition))) {
+		if (input_policy) {
+			uint16_t pad = trigger_eval(input_policy);
+			if (pad != impl->input.pad[0]) {
+				impl->input.pad[0] = pad;
+				TRACE_BEGIN(trace_start);
+				impl->api->gpgx_put_control(&impl->input, sizeof(gpgx_api_input_data_t));
+				TRACE_END("gpgx_put_control", trace_start);
+			}
+		}
+
+		gpgx_impl_advance(&impl->core);
+		frames++;
+
+		if (frame_cb) {
+			frame_cb(userdata, impl->input.pad[0]);
+		}
+	}
+
+	return frames;
+}
+
 core_t* gpgx_impl_create(void) {
 	gpgx_impl_t* impl = zalloc(sizeof(gpgx_impl_t));
 	impl->core.init = gpgx_impl_init;
@@ -228,92 +473,156 @@ core_t* gpgx_impl_create(void) {
 	impl->api = gpgx_api_create(impl->wbx);
 	return &impl->core;
 }
-/*
-#define DRIFT_ADDR 0x6FFA
-#define BAD_DRIFT 0xA0
+#include "movie.h"
+#include "sync_log.h"
 
-#define DISTANCE_ADDR 0x6FDC
-#define TARGET_DISTANCE 0x9E340
-#define READ_DISTANCE() ((uint32_t)(*(uint16_t*)&m68k_ram[DISTANCE_ADDR] << 16) | *(uint16_t*)&m68k_ram[DISTANCE_ADDR + 2])
+#define MOVIE_FILE "movie_out.shm"
+#define RAW_MOVIE_FILE "movie_out.bin"
+#define SYNC_LOG_FILE "movie_out.sync"
+#define SYNC_LOG_INTERVAL 60
+#define SYNC_LOG_WORD_RAM false // also hash word RAM, catches sub CPU desyncs sooner at some cost
 
-#define SPEED_ADDR 0x6FEA
+static uint32_t get_sync_log_domains(core_t* core, sync_log_domain_t domains[2]) {
+	gpgx_impl_t* impl = (gpgx_impl_t*)core;
+	domains[0].data = impl->m68k_ram;
+	domains[0].size = 0x10000;
+	if (!SYNC_LOG_WORD_RAM) {
+		return 1;
+	}
 
-#define SCORE_TIMER_ADDR 0x7139
+	uint8_t* word_ram = gpgx_impl_get_memdom(core, "WORD RAM", &domains[1].size);
+	if (!word_ram) {
+		FATAL_ERROR("Could not find word RAM for the sync log");
+	}
+	domains[1].data = word_ram;
+	return 2;
+}
 
-#define MOVIE_BUFFER_SIZE 1073741824
+#ifdef SLIMHAWK_BOT
 
-#define ADD_MOVIE_INPUT() do { \
-	movie_buffer[movie_buffer_pos++] = input.pad[0]; \
-	if (__builtin_expect(movie_buffer_pos == MOVIE_BUFFER_SIZE, false)) { \
-		fwrite(movie_buffer, sizeof(uint8_t), MOVIE_BUFFER_SIZE, movie_file); \
-		movie_buffer_pos = 0; \
-	} \
-} while (0)
+#include "hash.h"
+#include "search.h"
+#include "ttable.h"
 
-#include "intro_inputs.h"
+// bot conditions, compiled into triggers at startup
+#define DISTANCE_REACHED "u32[0x6FDC] >= 0x9E340"
+#define APPROACH_REACHED "u32[0x6FDC] >= 0x9E340 - 0x400"
+#define STOPPED_OR_DISTANCE_REACHED "u16[0x6FEA] == 0 || u32[0x6FDC] >= 0x9E340"
+#define SCORE_TIMER_READY "u8[0x7139] == 1"
+#define DRIVE_INPUT "u8[0x6FFA] > 0xA0 ? 0x44 : 0x40" // A+L if drifting too far, otherwise A
+#define APPROACH_INPUT "u8[0x6FFA] > 0x50 ? 0x44 : 0x40"
+#define NO_INPUT "0"
+#define START_INPUT "0x80"
 
-int main(int argc, char* argv[]) {
-	gpgx_impl_t* impl = (gpgx_impl_t*)core_parse_cli(argc, argv);
-	wbx_impl_enter(impl->wbx);
+// optionally beam search the steering once the approach is reached, rather than relying on the retry loop alone
+#define SEARCH_WORKERS 0 // 0 disables the search
+#define SEARCH_SCORE "0x100 - u8[0x6FFA]" // further left on the road is better
+#define SEARCH_FRAMES_PER_INPUT 1
+#define SEARCH_HORIZON 120
+#define SEARCH_BEAM_WIDTH 64
+#define SEARCH_MOVIE_FILE "search_out.shm"
+#define SEARCH_TTABLE_SIZE (1 << 20)
 
-	FILE* movie_file = fopen("movie_out.bin", "wb");
-	if (!movie_file) {
-		FATAL_ERROR("Could not open movie file");
-	}
-	uint8_t* movie_buffer = salloc(MOVIE_BUFFER_SIZE); // 1 GiB buffer
-	uint32_t movie_buffer_pos = 0;
+// states passed through by failed coasts in the retry loop
+#define RETRY_TTABLE_SIZE (1 << 20)
 
-	uint8_t* m68k_ram = NULL;
-	int32_t size = 0;
-	const char* name = impl->api->gpgx_get_memdom(0, &m68k_ram, &size);
-	if (!m68k_ram || size != 0x10000 || !name || strcmp("68K RAM", name)) {
-		FATAL_ERROR("Interop error in gpgx_get_memdom");
+static const uint8_t search_alphabet[] = { 0x40, 0x44 };
+
+typedef struct {
+	gpgx_impl_t* impl;
+	movie_writer_t* movie;
+	sync_log_t* sync_log;
+	uint8_t last_pad;
+} bot_recorder_t;
+
+static void bot_add_movie_input(void* userdata, uint16_t pad) {
+	bot_recorder_t* recorder = userdata;
+
+	// input on a lag frame is never read, so continue the current run rather than starting a new one
+	if (!recorder->impl->is_lag_frame) {
+		recorder->last_pad = pad;
 	}
 
-	gpgx_api_input_data_t input;
-	if (!impl->api->gpgx_get_control(&input, sizeof(gpgx_api_input_data_t))) {
-		FATAL_ERROR("Interop error in gpgx_get_control");
+	movie_writer_append(recorder->movie, recorder->last_pad, 1);
+	sync_log_frame(recorder->sync_log, movie_writer_get_num_frames(recorder->movie));
+}
+
+typedef struct {
+	int argc;
+	char** argv;
+} bot_cli_t;
+
+static core_t* bot_create_search_core(void* userdata) {
+	bot_cli_t* cli = userdata;
+	return core_parse_cli(cli->argc, cli->argv);
+}
+
+#include "intro_inputs.h"
+
+int main(int argc, char* argv[]) {
+	TRACE_THREAD_NAME("emulator");
+
+	// workers are forked before our own core is created, as its disc starts threads (which don't survive a fork)
+	bot_cli_t cli = { argc, argv };
+	search_t* search = NULL;
+	if (SEARCH_WORKERS) {
+		search_config_t config;
+		config.create_core = bot_create_search_core;
+		config.userdata = &cli;
+		config.alphabet = search_alphabet;
+		config.alphabet_len = sizeof(search_alphabet);
+		config.frames_per_input = SEARCH_FRAMES_PER_INPUT;
+		config.score = SEARCH_SCORE;
+		config.goal = NULL;
+		config.horizon = SEARCH_HORIZON;
+		config.beam_width = SEARCH_BEAM_WIDTH;
+		config.num_workers = SEARCH_WORKERS;
+		config.ttable_size = SEARCH_TTABLE_SIZE;
+		config.ttable_domains = NULL;
+		config.num_ttable_domains = 0;
+		search = search_create(&config);
 	}
 
+	core_t* core = core_parse_cli(argc, argv);
+	gpgx_impl_t* impl = (gpgx_impl_t*)core;
+	wbx_impl_enter(impl->wbx);
+
+	bot_recorder_t recorder;
+	recorder.impl = impl;
+	recorder.movie = movie_writer_create(MOVIE_FILE);
+	recorder.last_pad = 0;
+	sync_log_domain_t sync_log_domains[2];
+	uint32_t num_sync_log_domains = get_sync_log_domains(core, sync_log_domains);
+	recorder.sync_log = sync_log_create_recorder(SYNC_LOG_FILE, SYNC_LOG_INTERVAL, sync_log_domains, num_sync_log_domains);
+
+	trigger_t* distance_reached = gpgx_impl_compile_trigger(core, DISTANCE_REACHED);
+	trigger_t* approach_reached = gpgx_impl_compile_trigger(core, APPROACH_REACHED);
+	trigger_t* stopped_or_distance_reached = gpgx_impl_compile_trigger(core, STOPPED_OR_DISTANCE_REACHED);
+	trigger_t* score_timer_ready = gpgx_impl_compile_trigger(core, SCORE_TIMER_READY);
+	trigger_t* drive_input = gpgx_impl_compile_trigger(core, DRIVE_INPUT);
+	trigger_t* approach_input = gpgx_impl_compile_trigger(core, APPROACH_INPUT);
+	trigger_t* no_input = gpgx_impl_compile_trigger(core, NO_INPUT);
+	trigger_t* start_input = gpgx_impl_compile_trigger(core, START_INPUT);
+
 	for (uint32_t i = 0; i < sizeof(intro_inputs); i++) {
-		input.pad[0] = intro_inputs[i];
-		ADD_MOVIE_INPUT();
-		impl->api->gpgx_put_control(&input, sizeof(gpgx_api_input_data_t));
-		impl->api->gpgx_advance();
+		impl->input.pad[0] = intro_inputs[i];
+		impl->api->gpgx_put_control(&impl->input, sizeof(gpgx_api_input_data_t));
+		gpgx_impl_advance(core);
+		bot_add_movie_input(&recorder, impl->input.pad[0]);
 	}
 
 	for (uint32_t i = 0; i < 98; i++) {
 		// drive until distance is the target distance (at which point, the game awards a point)
-		while (READ_DISTANCE() < TARGET_DISTANCE) {
-			if (m68k_ram[DRIFT_ADDR ^ 1] > BAD_DRIFT) {
-				input.pad[0] = 0x44; // A+L
-			} else {
-				input.pad[0] = 0x40; // A
-			}
-
-			ADD_MOVIE_INPUT();
-			impl->api->gpgx_put_control(&input, sizeof(gpgx_api_input_data_t));
-			impl->api->gpgx_advance();
-		}
-
-		// reset input
-		input.pad[0] = 0;
-		impl->api->gpgx_put_control(&input, sizeof(gpgx_api_input_data_t));
+		gpgx_impl_run_until(core, distance_reached, drive_input, UINT32_MAX, bot_add_movie_input, &recorder);
 
-		// wait until the score timer is at 1
-		while (m68k_ram[SCORE_TIMER_ADDR ^ 1] != 1) {
-			ADD_MOVIE_INPUT();
-			impl->api->gpgx_advance();
-		}
-
-		input.pad[0] = 0x80; // Start
-		impl->api->gpgx_put_control(&input, sizeof(gpgx_api_input_data_t));
+		// release input until the score timer is at 1
+		gpgx_impl_run_until(core, score_timer_ready, no_input, UINT32_MAX, bot_add_movie_input, &recorder);
 
 		// press start for 2 frames (to start the next trip)
-		ADD_MOVIE_INPUT();
-		impl->api->gpgx_advance();
-		ADD_MOVIE_INPUT();
-		impl->api->gpgx_advance();
+		gpgx_impl_run_until(core, NULL, start_input, 2, bot_add_movie_input, &recorder);
+
+		// checkpoint the movie, so a crash from here on doesn't lose this point
+		movie_writer_sync(recorder.movie);
 
 		printf("Scored point - %d / 99\n", i + 1);
 		fflush(stdout);
@@ -332,82 +641,484 @@ int main(int argc, char* argv[]) {
 	// probably not super efficient, but these are the last few frames here
 	// so it doesn't really matter
 
-	while (READ_DISTANCE() < (TARGET_DISTANCE - 0x400)) {
-		if (m68k_ram[DRIFT_ADDR ^ 1] > 0x50) {
-			input.pad[0] = 0x44; // A+L
-		} else {
-			input.pad[0] = 0x40; // A
+	gpgx_impl_run_until(core, approach_reached, approach_input, UINT32_MAX, bot_add_movie_input, &recorder);
+	ttable_t* coast_ttable = ttable_create(RETRY_TTABLE_SIZE);
+
+	if (search) {
+		uintptr_t state_len;
+		void* state = gpgx_impl_save_state(core, &state_len);
+		search_result_t result;
+		search_run(search, state, state_len, &result);
+		search_write_movie(search, &result, SEARCH_MOVIE_FILE);
+		free(state);
+
+		// replay the best path here, so it's recorded like any other input
+		// each input is held for as many frames as the search held it, lag frames included (the recorder handles those)
+		for (uint32_t i = 0; i < result.num_inputs; i++) {
+			impl->input.pad[0] = result.inputs[i];
+			impl->api->gpgx_put_control(&impl->input, sizeof(gpgx_api_input_data_t));
+			gpgx_impl_run_until(core, NULL, NULL, SEARCH_FRAMES_PER_INPUT, bot_add_movie_input, &recorder);
 		}
 
-		ADD_MOVIE_INPUT();
-		impl->api->gpgx_put_control(&input, sizeof(gpgx_api_input_data_t));
-		impl->api->gpgx_advance();
+		search_free_result(&result);
+		search_destroy(search);
 	}
 
 	while (true) {
 		// save state
 		uintptr_t state_len;
-		void* state = wbx_impl_save_state(impl->wbx, &state_len);
-
-		// reset input
-		input.pad[0] = 0;
-		impl->api->gpgx_put_control(&input, sizeof(gpgx_api_input_data_t));
-
-		while (READ_DISTANCE() < TARGET_DISTANCE) {
-			if (!*(uint16_t*)&m68k_ram[SPEED_ADDR]) {
-				// we stopped, try again
-				break;
-			}
-			impl->api->gpgx_advance();
+		void* state = gpgx_impl_save_state(core, &state_len);
+		uint64_t state_frame = movie_writer_get_num_frames(recorder.movie);
+
+		// release input, and coast until we either stop or reach the target
+		// if we pass through a state an earlier failed coast reached by the same frame, this one will fail too
+		impl->input.pad[0] = 0;
+		impl->api->gpgx_put_control(&impl->input, sizeof(gpgx_api_input_data_t));
+		uint64_t coast_frame = state_frame;
+		bool converged = false;
+		while (!converged && !trigger_eval(stopped_or_distance_reached)) {
+			gpgx_impl_advance(core);
+			converged = ttable_check(coast_ttable, hash_128(impl->m68k_ram, 0x10000, 0), ++coast_frame);
 		}
 
-		if (READ_DISTANCE() < TARGET_DISTANCE) {
-			wbx_impl_load_state(impl->wbx, state, state_len);
+		if (converged || !trigger_eval(distance_reached)) {
+			// we stopped, try again a frame later
+			gpgx_impl_load_state(core, state, state_len);
+			movie_writer_truncate(recorder.movie, state_frame);
+			sync_log_seek(recorder.sync_log, state_frame);
 			free(state);
 
-			if (m68k_ram[DRIFT_ADDR ^ 1] > 0x50) {
-				input.pad[0] = 0x44; // A+L
-			} else {
-				input.pad[0] = 0x40; // A
-			}
-
-			ADD_MOVIE_INPUT();
-			impl->api->gpgx_put_control(&input, sizeof(gpgx_api_input_data_t));
-			impl->api->gpgx_advance();
+			// releasing input after a lag frame plays out the same as releasing it before, which we just tried
+			do {
+				gpgx_impl_run_until(core, NULL, approach_input, 1, bot_add_movie_input, &recorder);
+			} while (impl->is_lag_frame);
 		} else {
 			// stop movie
-			fwrite(movie_buffer, sizeof(uint8_t), movie_buffer_pos, movie_file);
-			fclose(movie_file);
-			free(movie_buffer);
+			movie_writer_destroy(recorder.movie);
+			sync_log_destroy(recorder.sync_log);
 			free(state); // make sure to free the state
 			break;
 		}
 	}
 
-	puts("Scored final point! - 99 / 99");
+	printf("Scored final point! - 99 / 99 (%ld lag frames)\n", impl->lag_frames);
 	fflush(stdout);
+	ttable_print_stats(coast_ttable, "Retry loop");
+	ttable_destroy(coast_ttable);
+
+	trigger_destroy(distance_reached);
+	trigger_destroy(approach_reached);
+	trigger_destroy(stopped_or_distance_reached);
+	trigger_destroy(score_timer_ready);
+	trigger_destroy(drive_input);
+	trigger_destroy(approach_input);
+	trigger_destroy(no_input);
+	trigger_destroy(start_input);
+
+	wbx_impl_exit(impl->wbx);
+	gpgx_impl_destroy(core);
+
+	TRACE_WRITE();
+	PERF_PRINT();
+	return 0;
+}
+
+#elif defined(SLIMHAWK_CHECKPOINT)
+
+#include "min_max.h"
+#include "checkpoint.h"
+
+#define CHECKPOINT_PREFIX "state"
+#define CHECKPOINT_INDEX_FILE "state_index.txt"
+#define CHECKPOINT_INTERVAL 2588602 // every chunk boundary, 0 to only use checkpoint_frames
+
+// extra frames to checkpoint, ascending, terminated by UINT64_MAX
+static const uint64_t checkpoint_frames[] = { UINT64_MAX };
+
+static uint64_t next_checkpoint(uint64_t frame, const uint64_t** extra_frame) {
+	while (**extra_frame <= frame) {
+		(*extra_frame)++;
+	}
+
+	uint64_t next = **extra_frame;
+	if (CHECKPOINT_INTERVAL) {
+		next = MIN(next, (frame / CHECKPOINT_INTERVAL + 1) * CHECKPOINT_INTERVAL);
+	}
+	return next;
+}
+
+// states are saved with everything drawn, so whatever loads them renders normally
+static void checkpoint(gpgx_impl_t* impl, checkpoint_writer_t* writer, uint64_t frame) {
+	impl->api->gpgx_set_draw_mask(GPGX_IMPL_DRAW_ALL);
+	uintptr_t state_len;
+	void* state = gpgx_impl_save_state(&impl->core, &state_len);
+	checkpoint_writer_push(writer, frame, state, state_len);
+	impl->api->gpgx_set_draw_mask(0);
+}
+
+int main(int argc, char* argv[]) {
+	TRACE_THREAD_NAME("emulator");
+	core_t* core = core_parse_cli(argc, argv);
+	gpgx_impl_t* impl = (gpgx_impl_t*)core;
+	wbx_impl_enter(impl->wbx);
+
+	movie_reader_t* movie = movie_reader_create(MOVIE_FILE);
+
+	sync_log_t* sync_log = NULL;
+	if (!access(SYNC_LOG_FILE, F_OK)) {
+		sync_log_domain_t sync_log_domains[2];
+		uint32_t num_sync_log_domains = get_sync_log_domains(core, sync_log_domains);
+		sync_log = sync_log_create_verifier(SYNC_LOG_FILE, sync_log_domains, num_sync_log_domains);
+	}
+
+	checkpoint_writer_t* writer = checkpoint_writer_create(CHECKPOINT_PREFIX, CHECKPOINT_INDEX_FILE);
+
+	// nothing is displayed or encoded, so skip as much rendering as we can
+	impl->api->gpgx_set_draw_mask(0);
+
+	// the power on state is the start of the first chunk
+	uint64_t frame = 0;
+	checkpoint(impl, writer, frame);
+
+	const uint64_t* extra_frame = checkpoint_frames;
+	uint64_t checkpoint_frame = next_checkpoint(frame, &extra_frame);
+	uint64_t run_len;
+	uint8_t pad;
+	while ((run_len = movie_reader_next_run(movie, &pad, checkpoint_frame - frame))) {
+		impl->input.pad[0] = pad;
+		TRACE_BEGIN(trace_start);
+		impl->api->gpgx_put_control(&impl->input, sizeof(gpgx_api_input_data_t));
+		TRACE_END("gpgx_put_control", trace_start);
+		for (uint64_t i = 0; i < run_len; i++) {
+			gpgx_impl_advance(core);
+			frame++;
+			if (sync_log) {
+				sync_log_frame(sync_log, frame);
+			}
+		}
+
+		if (frame == checkpoint_frame) {
+			checkpoint(impl, writer, frame);
+			checkpoint_frame = next_checkpoint(frame, &extra_frame);
+			printf("Checkpointed frame %ld / %ld\n", frame, movie_reader_get_num_frames(movie));
+			fflush(stdout);
+		}
+	}
+
+	checkpoint_writer_destroy(writer);
+	movie_reader_destroy(movie);
+	if (sync_log) {
+		sync_log_destroy(sync_log);
+	}
+
+	wbx_impl_exit(impl->wbx);
+	gpgx_impl_destroy(core);
+
+	TRACE_WRITE();
+	PERF_PRINT();
+	return 0;
+}
+
+#elif defined(SLIMHAWK_RAM_SEARCH)
+
+#include "min_max.h"
+#include "ram_search.h"
+
+#define RAM_SEARCH_RING_LEN 64 // must be more than the largest age used by a step
+#define RAM_SEARCH_MAX_RESULTS 64
+
+// filters applied while the movie plays, each every interval frames from start to end (inclusive)
+typedef struct {
+	uint64_t start;
+	uint64_t end;
+	uint64_t interval;
+	ram_search_filter_t filter;
+} ram_search_step_t;
+
+// edit these for what's known about the value being searched for
+// e.g. the distance counter (u32 at 0x6FDC) only counts up while driving the first trip
+static const ram_search_step_t ram_search_steps[] = {
+	{ 20000, 30000, 60, { RAM_SEARCH_GREATER, 4, true, 60, 0 } },
+	{ 20000, 30000, 1, { RAM_SEARCH_GREATER_EQUAL, 4, true, 1, 0 } },
+};
+
+#define RAM_SEARCH_NUM_STEPS (sizeof(ram_search_steps) / sizeof(ram_search_step_t))
+
+int main(int argc, char* argv[]) {
+	TRACE_THREAD_NAME("emulator");
+	core_t* core = core_parse_cli(argc, argv);
+	gpgx_impl_t* impl = (gpgx_impl_t*)core;
+	wbx_impl_enter(impl->wbx);
+
+	movie_reader_t* movie = movie_reader_create(MOVIE_FILE);
+
+	sync_log_t* sync_log = NULL;
+	if (!access(SYNC_LOG_FILE, F_OK)) {
+		sync_log_domain_t sync_log_domains[2];
+		uint32_t num_sync_log_domains = get_sync_log_domains(core, sync_log_domains);
+		sync_log = sync_log_create_verifier(SYNC_LOG_FILE, sync_log_domains, num_sync_log_domains);
+	}
+
+	ram_search_domain_t domain;
+	domain.name = "68K RAM";
+	domain.data = impl->m68k_ram;
+	domain.size = 0x10000;
+	domain.word_swapped = true;
+	ram_search_t* search = ram_search_create(&domain, 1, RAM_SEARCH_RING_LEN);
+
+	uint64_t last_frame = 0;
+	for (uint32_t i = 0; i < RAM_SEARCH_NUM_STEPS; i++) {
+		last_frame = MAX(last_frame, ram_search_steps[i].end);
+	}
+
+	// nothing is displayed, so skip as much rendering as we can
+	impl->api->gpgx_set_draw_mask(0);
+
+	// the whole search happens in one pass, snapshotting every frame and filtering on the frames steps ask for
+	uint64_t frame = 0;
+	uint64_t run_len;
+	uint8_t pad;
+	while ((run_len = movie_reader_next_run(movie, &pad, last_frame - frame))) {
+		impl->input.pad[0] = pad;
+		TRACE_BEGIN(trace_start);
+		impl->api->gpgx_put_control(&impl->input, sizeof(gpgx_api_input_data_t));
+		TRACE_END("gpgx_put_control", trace_start);
+		for (uint64_t i = 0; i < run_len; i++) {
+			gpgx_impl_advance(core);
+			frame++;
+			if (sync_log) {
+				sync_log_frame(sync_log, frame);
+			}
+
+			ram_search_snapshot(search);
+
+			for (uint32_t j = 0; j < RAM_SEARCH_NUM_STEPS; j++) {
+				const ram_search_step_t* step = &ram_search_steps[j];
+				if (frame >= step->start && frame <= step->end && !((frame - step->start) % step->interval)) {
+					ram_search_filter(search, &step->filter);
+				}
+			}
+		}
+	}
+
+	const ram_search_filter_t* last_filter = &ram_search_steps[RAM_SEARCH_NUM_STEPS - 1].filter;
+	ram_search_print(search, last_filter->width, last_filter->big_endian, RAM_SEARCH_MAX_RESULTS);
+
+	ram_search_destroy(search);
+	movie_reader_destroy(movie);
+	if (sync_log) {
+		sync_log_destroy(sync_log);
+	}
+
+	wbx_impl_exit(impl->wbx);
+	gpgx_impl_destroy(core);
+
+	TRACE_WRITE();
+	PERF_PRINT();
+	return 0;
+}
+
+#elif defined(SLIMHAWK_BENCH)
+
+#include <stdlib.h>
+#include <sys/resource.h>
+#include <time.h>
+
+#include "file.h"
+#include "hash.h"
+#include "encoding_impl.h"
+#include "intro_inputs.h"
+
+#define BENCH_STATE_FILE "bench_state.bin" // optional, the intro inputs are played from power on without it
+#define BENCH_OUTPUT_FILE "bench.json"
+#define BENCH_VIDEO_FILE "bench.avi"
+#define BENCH_FRAMES sizeof(intro_inputs) // the inputs loop if this is longer
+
+typedef enum {
+	BENCH_TURBO, // nothing rendered
+	BENCH_RENDER, // video and audio rendered, but nothing done with them
+	BENCH_ENCODE, // rendered and encoded, like the encode mode
+	BENCH_NUM_CONFIGS,
+} bench_config_t;
+
+static const char* const bench_config_names[BENCH_NUM_CONFIGS] = { "turbo", "render", "render_encode" };
+
+static uint64_t bench_now(void) {
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+}
+
+static uint64_t bench_rss_kib(void) {
+	FILE* f = fopen("/proc/self/statm", "r");
+	unsigned long pages = 0;
+	if (!f || fscanf(f, "%*u %lu", &pages) != 1) {
+		FATAL_ERROR("Could not read /proc/self/statm");
+	}
+	fclose(f);
+	return pages * (sysconf(_SC_PAGESIZE) / 1024);
+}
+
+static int bench_compare_times(const void* a, const void* b) {
+	uint64_t x = *(const uint64_t*)a;
+	uint64_t y = *(const uint64_t*)b;
+	return (x > y) - (x < y);
+}
+
+static uint64_t bench_percentile(const uint64_t* sorted, uint64_t count, uint32_t percent) {
+	return sorted[(count - 1) * percent / 100];
+}
+
+static void bench_run(gpgx_impl_t* impl, bench_config_t config, void* state, uintptr_t state_len, sync_log_t* sync_log, uint64_t* frame_times, FILE* out) {
+	gpgx_impl_load_state(&impl->core, state, state_len);
+	if (sync_log) {
+		sync_log_seek(sync_log, 0);
+	}
+	impl->api->gpgx_set_draw_mask(config == BENCH_TURBO ? 0 : GPGX_IMPL_DRAW_ALL);
+	uint64_t lag_frames = impl->lag_frames;
+
+	uint32_t* video_buffer;
+	int32_t pitch;
+	impl->api->gpgx_get_video(NULL, NULL, &pitch, &video_buffer);
+	int16_t* audio_buffer;
+	impl->api->gpgx_get_audio(NULL, &audio_buffer);
+	int32_t num_samples = 0;
+
+	encoding_impl_t* encoder = NULL;
+	if (config == BENCH_ENCODE) {
+		int32_t fps_num, fps_den;
+		impl->api->gpgx_get_fps(&fps_num, &fps_den);
+		encoder = encoding_impl_create(BENCH_VIDEO_FILE, "avi", "h264", 1024 * 12, 320, 224, fps_num, fps_den, 1024);
+	}
+
+	uint64_t start = bench_now();
+	uint64_t last = start;
+	for (uint64_t i = 0; i < BENCH_FRAMES; i++) {
+		impl->input.pad[0] = intro_inputs[i % sizeof(intro_inputs)];
+		impl->api->gpgx_put_control(&impl->input, sizeof(gpgx_api_input_data_t));
+		gpgx_impl_advance(&impl->core);
+		if (config != BENCH_TURBO) {
+			impl->api->gpgx_get_audio(&num_samples, NULL);
+		}
+		if (encoder) {
+			encoding_impl_push_frame(encoder, video_buffer, pitch, audio_buffer, num_samples);
+		}
+		// the bot's movie only matches while the intro inputs are played
+		if (sync_log && i < sizeof(intro_inputs)) {
+			sync_log_frame(sync_log, i + 1);
+		}
+
+		uint64_t now = bench_now();
+		frame_times[i] = now - last;
+		last = now;
+	}
+
+	// the encoder only catches up here, so it counts towards the total but not any one frame
+	if (encoder) {
+		encoding_impl_destroy(encoder);
+	}
+	uint64_t total = bench_now() - start;
+	uint64_t rss = bench_rss_kib();
+
+	// every config should end in the same state, so a mismatch here means rendering changed emulation
+	hash128_t ram_hash = hash_128(impl->m68k_ram, 0x10000, 0);
+
+	qsort(frame_times, BENCH_FRAMES, sizeof(uint64_t), bench_compare_times);
+	fprintf(out, "\t\t{\n");
+	fprintf(out, "\t\t\t\"name\": \"%s\",\n", bench_config_names[config]);
+	fprintf(out, "\t\t\t\"seconds\": %.6f,\n", total / 1e9);
+	fprintf(out, "\t\t\t\"fps\": %.3f,\n", BENCH_FRAMES * 1e9 / total);
+	fprintf(out, "\t\t\t\"ns_per_frame\": { \"min\": %lu, \"p50\": %lu, \"p90\": %lu, \"p99\": %lu, \"max\": %lu },\n",
+		frame_times[0], bench_percentile(frame_times, BENCH_FRAMES, 50), bench_percentile(frame_times, BENCH_FRAMES, 90),
+		bench_percentile(frame_times, BENCH_FRAMES, 99), frame_times[BENCH_FRAMES - 1]);
+	fprintf(out, "\t\t\t\"rss_kib\": %lu,\n", rss);
+	fprintf(out, "\t\t\t\"lag_frames\": %lu,\n", impl->lag_frames - lag_frames);
+	fprintf(out, "\t\t\t\"ram_hash\": \"%016lx%016lx\"\n", ram_hash.hi, ram_hash.lo);
+	fprintf(out, "\t\t}%s\n", config == BENCH_NUM_CONFIGS - 1 ? "" : ",");
+}
+
+int main(int argc, char* argv[]) {
+	TRACE_THREAD_NAME("emulator");
+	gpgx_impl_t* impl = (gpgx_impl_t*)core_parse_cli(argc, argv);
+	wbx_impl_enter(impl->wbx);
+
+	void* state = NULL;
+	uintptr_t state_len;
+	bool supplied_state = !access(BENCH_STATE_FILE, F_OK);
+	if (supplied_state) {
+		state_len = read_entire_file(BENCH_STATE_FILE, &state);
+	} else {
+		state = gpgx_impl_save_state(&impl->core, &state_len);
+	}
+
+	// from power on the intro inputs are the start of the bot's movie, so verify against its sync log if we have it
+	sync_log_t* sync_log = NULL;
+	if (!supplied_state && !access(SYNC_LOG_FILE, F_OK)) {
+		sync_log_domain_t sync_log_domains[2];
+		uint32_t num_sync_log_domains = get_sync_log_domains(&impl->core, sync_log_domains);
+		sync_log = sync_log_create_verifier(SYNC_LOG_FILE, sync_log_domains, num_sync_log_domains);
+	}
+
+	FILE* out = fopen(BENCH_OUTPUT_FILE, "w");
+	if (!out) {
+		FATAL_ERROR("Could not open bench output %s", BENCH_OUTPUT_FILE);
+	}
+
+	fprintf(out, "{\n");
+	fprintf(out, "\t\"state\": \"%s\",\n", supplied_state ? BENCH_STATE_FILE : "power on");
+	fprintf(out, "\t\"frames\": %lu,\n", (uint64_t)BENCH_FRAMES);
+	fprintf(out, "\t\"configs\": [\n");
+
+	uint64_t* frame_times = salloc(sizeof(uint64_t) * BENCH_FRAMES);
+	for (uint32_t i = 0; i < BENCH_NUM_CONFIGS; i++) {
+		bench_run(impl, i, state, state_len, sync_log, frame_times, out);
+	}
+	free(frame_times);
+	free(state);
+	if (sync_log) {
+		sync_log_destroy(sync_log);
+	}
+
+	struct rusage usage;
+	getrusage(RUSAGE_SELF, &usage);
+	fprintf(out, "\t],\n");
+	fprintf(out, "\t\"max_rss_kib\": %ld\n", usage.ru_maxrss);
+	fprintf(out, "}\n");
+	if (fclose(out)) {
+		FATAL_ERROR("Failed to write bench output %s", BENCH_OUTPUT_FILE);
+	}
 
 	wbx_impl_exit(impl->wbx);
 	gpgx_impl_destroy(&impl->core);
 
+	TRACE_WRITE();
+	PERF_PRINT();
 	return 0;
 }
-*/
+
+#else
 
 #include "file.h"
+#include "checkpoint.h"
 #include "encoding_impl.h"
 
 #define VIDEO_CHUNK_LEN 2588602
 #define VIDEO_NUM 2
 #define VIDEO_FILE "desert_bus_2.avi"
-#define STATE_FILE "state_2.bin"
+#define STATE_INDEX_FILE "state_index.txt" // written by the checkpoint mode
 
 int main(int argc, char* argv[]) {
+	TRACE_THREAD_NAME("emulator");
 	gpgx_impl_t* impl = (gpgx_impl_t*)core_parse_cli(argc, argv);
 	wbx_impl_enter(impl->wbx);
 
-	uint8_t* movie_buffer = NULL;
-	size_t movie_len = read_entire_file("movie_out.bin", &movie_buffer);
+	// one time conversion for movies from before the compact format
+	if (access(MOVIE_FILE, F_OK) && !access(RAW_MOVIE_FILE, F_OK)) {
+		movie_convert_raw(RAW_MOVIE_FILE, MOVIE_FILE);
+	}
+
+	movie_reader_t* movie = movie_reader_create(MOVIE_FILE);
+	uint64_t movie_len = movie_reader_get_num_frames(movie);
 	if (movie_len != 171285255) {
 		FATAL_ERROR("Wrong movie len (expected 171285255, got %ld", movie_len);
 	}
@@ -417,6 +1128,15 @@ int main(int argc, char* argv[]) {
 		FATAL_ERROR("Interop error in gpgx_get_control");
 	}
 
+	// verify against the bot's sync log if we have it
+	sync_log_t* sync_log = NULL;
+	if (!access(SYNC_LOG_FILE, F_OK)) {
+		sync_log_domain_t sync_log_domains[2];
+		uint32_t num_sync_log_domains = get_sync_log_domains(&impl->core, sync_log_domains);
+		sync_log = sync_log_create_verifier(SYNC_LOG_FILE, sync_log_domains, num_sync_log_domains);
+		sync_log_seek(sync_log, VIDEO_NUM * VIDEO_CHUNK_LEN);
+	}
+
 	int32_t fps_num, fps_den;
 	impl->api->gpgx_get_fps(&fps_num, &fps_den);
 
@@ -428,26 +1148,54 @@ int main(int argc, char* argv[]) {
 	impl->api->gpgx_get_audio(NULL, &audio_buffer);
 	int32_t num_samples;
 
+	char state_path[4096];
+	if (!checkpoint_find(STATE_INDEX_FILE, VIDEO_NUM * VIDEO_CHUNK_LEN, state_path, sizeof(state_path))) {
+		FATAL_ERROR("No checkpoint for frame %d in %s", VIDEO_NUM * VIDEO_CHUNK_LEN, STATE_INDEX_FILE);
+	}
+
 	void* state = NULL;
-	uintptr_t state_len = read_entire_file(STATE_FILE, &state);
-	wbx_impl_load_state(impl->wbx, state, state_len);
+	uintptr_t state_len = read_entire_file(state_path, &state);
+	gpgx_impl_load_state(&impl->core, state, state_len);
 	free(state);
-	impl->api->gpgx_set_cdd_callback(impl->cd_read_cb);
-	impl->api->gpgx_invalidate_pattern_cache();
-
-	_Pragma("GCC unroll 8") for (uint32_t i = (VIDEO_NUM * VIDEO_CHUNK_LEN); i < ((VIDEO_NUM + 1) * VIDEO_CHUNK_LEN); i++) {
-		input.pad[0] = movie_buffer[i];
+	impl->api->gpgx_set_draw_mask(GPGX_IMPL_DRAW_ALL);
+
+	movie_reader_seek(movie, VIDEO_NUM * VIDEO_CHUNK_LEN);
+	uint64_t frame = VIDEO_NUM * VIDEO_CHUNK_LEN;
+	uint64_t frames_left = VIDEO_CHUNK_LEN;
+	uint64_t run_len;
+	uint8_t pad;
+	while ((run_len = movie_reader_next_run(movie, &pad, frames_left))) {
+		input.pad[0] = pad;
+		TRACE_BEGIN(trace_put_control);
 		impl->api->gpgx_put_control(&input, sizeof(gpgx_api_input_data_t));
-		impl->api->gpgx_advance();
-		impl->api->gpgx_get_audio(&num_samples, NULL);
-		encoding_impl_push_frame(encoder, video_buffer, pitch, audio_buffer, num_samples); 
+		TRACE_END("gpgx_put_control", trace_put_control);
+		_Pragma("GCC unroll 8") for (uint64_t i = 0; i < run_len; i++) {
+			gpgx_impl_advance(&impl->core);
+			TRACE_BEGIN(trace_get_audio);
+			impl->api->gpgx_get_audio(&num_samples, NULL);
+			TRACE_END("gpgx_get_audio", trace_get_audio);
+			TRACE_BEGIN(trace_push_frame);
+			encoding_impl_push_frame(encoder, video_buffer, pitch, audio_buffer, num_samples);
+			TRACE_END("encoding_impl_push_frame", trace_push_frame);
+			if (sync_log) {
+				sync_log_frame(sync_log, ++frame);
+			}
+		}
+		frames_left -= run_len;
 	}
 
 	encoding_impl_destroy(encoder);
+	if (sync_log) {
+		sync_log_destroy(sync_log);
+	}
 
 	wbx_impl_exit(impl->wbx);
 	gpgx_impl_destroy(&impl->core);
-	free(movie_buffer);
+	movie_reader_destroy(movie);
 
+	TRACE_WRITE();
+	PERF_PRINT();
 	return 0;
-}
\ No newline at end of file
+}
+
+#endif
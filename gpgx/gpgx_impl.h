@@ -1,6 +1,106 @@
 #ifndef _GPGX_IMPL_H_
 #define _GPGX_IMPL_H_
 
+#include "core.h"
+#include "gpgx_api.h"
+#include "perf.h"
+#include "profiler.h"
+#include "trace.h"
+#include "trigger.h"
+
+typedef enum {
+	GPGX_IMPL_WATCH_READ,
+	GPGX_IMPL_WATCH_WRITE,
+	GPGX_IMPL_WATCH_EXEC,
+	GPGX_IMPL_WATCH_KINDS,
+} gpgx_impl_watch_kind_t;
+
+typedef struct {
+	core_t core;
+	wbx_impl_t* wbx;
+	gpgx_api_t* api;
+	core_file_t* rom;
+	disc_impl_t* disc;
+	gpgx_api_cd_data_t* toc;
+	core_file_t* firmware;
+	void* load_archive_cb_stub;
+	gpgx_api_load_archive_cb_t load_archive_cb;
+	void* cd_read_cb_stub;
+	gpgx_api_cd_read_cb_t cd_read_cb;
+	void* input_cb_stub;
+	gpgx_api_input_cb_t input_cb;
+	void* mem_cb_stubs[GPGX_IMPL_WATCH_KINDS];
+	gpgx_api_mem_cb_t mem_cbs[GPGX_IMPL_WATCH_KINDS];
+	uint8_t* watch_bitmaps[GPGX_IMPL_WATCH_KINDS]; // a bit per 24-bit bus address, allocated by the first watch of its kind and kept until the core is destroyed
+	bool watching[GPGX_IMPL_WATCH_KINDS]; // anything of the kind is watched, its callback is unregistered otherwise
+	uint64_t watch_hits[GPGX_IMPL_WATCH_KINDS];
+	profiler_t* profiler;
+	uint32_t profile_frame_interval;
+	uint32_t profile_frame;
+	bool profiling; // exec callback is registered for the profiler this frame
+	uint32_t* video_buffer;
+	uint32_t video_buffer_size;
+	int16_t* audio_buffer;
+	uint32_t audio_buffer_size;
+	uint8_t* m68k_ram;
+	gpgx_api_input_data_t input;
+	uint32_t polls; // input polls during the current frame
+	bool is_lag_frame; // the last frame never polled input
+	uint64_t lag_frames;
+} gpgx_impl_t;
+
+typedef void (*gpgx_impl_frame_cb_t)(void* userdata, uint16_t pad);
+
 core_t* gpgx_impl_create(void);
 
+void gpgx_impl_profile_frame(core_t* core);
+
+// advances a frame, keeping track of whether the game polled input during it
+static inline void gpgx_impl_advance(core_t* core) {
+	gpgx_impl_t* impl = (gpgx_impl_t*)core;
+	if (impl->profiler) {
+		gpgx_impl_profile_frame(core);
+	}
+
+	impl->polls = 0;
+	TRACE_BEGIN(trace_start);
+	PERF_ENTER(perf_resume, PERF_STAGE_EMULATION);
+	impl->api->gpgx_advance();
+	PERF_LEAVE(perf_resume);
+	TRACE_END("gpgx_advance", trace_start);
+	impl->is_lag_frame = !impl->polls;
+	impl->lag_frames += impl->is_lag_frame;
+}
+
+// finds a memory domain whose name contains name, returns NULL if there is none
+uint8_t* gpgx_impl_get_memdom(core_t* core, const char* name, uint32_t* size);
+
+// the state is malloc'd, loading also restores the host side callbacks and caches
+void* gpgx_impl_save_state(core_t* core, uintptr_t* length);
+void gpgx_impl_load_state(core_t* core, void* data, uintptr_t length);
+
+// gpgx_set_draw_mask value that renders every layer
+// the draw mask is part of a state, so a state saved with layers off renders nothing until the mask is set again
+#define GPGX_IMPL_DRAW_ALL -1
+
+// compiles a trigger over 68K RAM
+trigger_t* gpgx_impl_compile_trigger(core_t* core, const char* expr);
+
+// watches a range of 68K bus addresses (clamped to the end of the bus), counting accesses in watch_hits
+// gpgx can't end a frame from a callback, so hits are only seen once gpgx_advance returns
+// memory callbacks are only registered while something of their kind is watched, as every access goes through them
+void gpgx_impl_watch(core_t* core, gpgx_impl_watch_kind_t kind, uint32_t addr, uint32_t size);
+void gpgx_impl_unwatch(core_t* core, gpgx_impl_watch_kind_t kind); // unwatches everything of that kind
+
+// samples 68K PCs through the exec callback, see profiler.h
+// the exec callback fires for every instruction, so profiling only one of every frame_interval frames keeps the overhead down
+void gpgx_impl_start_profiler(core_t* core, uint32_t sample_every, uint32_t timer_hz, uint32_t frame_interval);
+void gpgx_impl_stop_profiler(core_t* core, const char* report_path, const char* collapsed_path);
+
+// advances until condition is true (checked before each frame) or max_frames have passed, returning the number of frames advanced
+// a NULL condition never stops early, a NULL input_policy leaves the current input as is
+// otherwise input_policy is evaluated before each frame, and its result is used as the pad input for that frame
+// frame_cb (if non-NULL) is called after each frame with the pad input used for it
+uint32_t gpgx_impl_run_until(core_t* core, trigger_t* condition, trigger_t* input_policy, uint32_t max_frames, gpgx_impl_frame_cb_t frame_cb, void* userdata);
+
 #endif
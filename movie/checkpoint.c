@@ -0,0 +1,151 @@
+#include <stdbool.h>
+#include <stdio.h>
+#include <string.h>
+#include <threads.h>
+
+#include "alloc.h"
+#include "fatal_error.h"
+#include "checkpoint.h"
+
+#define CHECKPOINT_MAX_PENDING 16
+
+typedef struct {
+	uint64_t frame;
+	void* state;
+	uintptr_t length;
+} checkpoint_t;
+
+struct checkpoint_writer_t {
+	char* prefix;
+	FILE* index;
+	checkpoint_t pending[CHECKPOINT_MAX_PENDING];
+	uint32_t head; // next to write out
+	uint32_t count;
+	thrd_t worker;
+	mtx_t lock;
+	cnd_t cond;
+	bool exit;
+};
+
+static void checkpoint_write(checkpoint_writer_t* writer, checkpoint_t* checkpoint) {
+	char path[4096];
+	snprintf(path, sizeof(path), "%s_%ld.bin", writer->prefix, checkpoint->frame);
+
+	FILE* f = fopen(path, "wb");
+	if (!f) {
+		FATAL_ERROR("Could not open checkpoint file %s", path);
+	}
+
+	if (fwrite(checkpoint->state, 1, checkpoint->length, f) != checkpoint->length || fclose(f)) {
+		FATAL_ERROR("Failed to write checkpoint file %s", path);
+	}
+
+	// only index the state once it is fully written
+	fprintf(writer->index, "%ld %s\n", checkpoint->frame, path);
+	if (fflush(writer->index)) {
+		FATAL_ERROR("Failed to write checkpoint index");
+	}
+}
+
+static int checkpoint_writer_worker_thread(void* arg) {
+	checkpoint_writer_t* writer = arg;
+	mtx_lock(&writer->lock);
+
+	while (true) {
+		while (!writer->count && !writer->exit) {
+			cnd_wait(&writer->cond, &writer->lock);
+		}
+
+		if (!writer->count) {
+			break;
+		}
+
+		checkpoint_t checkpoint = writer->pending[writer->head];
+		mtx_unlock(&writer->lock);
+		checkpoint_write(writer, &checkpoint);
+		free(checkpoint.state);
+		mtx_lock(&writer->lock);
+
+		writer->head = (writer->head + 1) % CHECKPOINT_MAX_PENDING;
+		writer->count--;
+		cnd_broadcast(&writer->cond);
+	}
+
+	mtx_unlock(&writer->lock);
+	return 0;
+}
+
+checkpoint_writer_t* checkpoint_writer_create(const char* prefix, const char* index_path) {
+	checkpoint_writer_t* writer = zalloc(sizeof(checkpoint_writer_t));
+	writer->prefix = salloc(strlen(prefix) + 1);
+	strcpy(writer->prefix, prefix);
+
+	writer->index = fopen(index_path, "w");
+	if (!writer->index) {
+		FATAL_ERROR("Could not open checkpoint index %s", index_path);
+	}
+
+	mtx_init(&writer->lock, mtx_plain);
+	cnd_init(&writer->cond);
+	thrd_create(&writer->worker, checkpoint_writer_worker_thread, writer);
+	return writer;
+}
+
+void checkpoint_writer_destroy(checkpoint_writer_t* writer) {
+	mtx_lock(&writer->lock);
+	writer->exit = true;
+	cnd_broadcast(&writer->cond);
+	mtx_unlock(&writer->lock);
+	thrd_join(writer->worker, NULL);
+
+	mtx_destroy(&writer->lock);
+	cnd_destroy(&writer->cond);
+	fclose(writer->index);
+	free(writer->prefix);
+	free(writer);
+}
+
+void checkpoint_writer_push(checkpoint_writer_t* writer, uint64_t frame, void* state, uintptr_t length) {
+	mtx_lock(&writer->lock);
+	while (writer->count == CHECKPOINT_MAX_PENDING) {
+		cnd_wait(&writer->cond, &writer->lock);
+	}
+
+	checkpoint_t* checkpoint = &writer->pending[(writer->head + writer->count) % CHECKPOINT_MAX_PENDING];
+	checkpoint->frame = frame;
+	checkpoint->state = state;
+	checkpoint->length = length;
+	writer->count++;
+	cnd_broadcast(&writer->cond);
+	mtx_unlock(&writer->lock);
+}
+
+bool checkpoint_find(const char* index_path, uint64_t frame, char* path, size_t path_size) {
+	FILE* index = fopen(index_path, "r");
+	if (!index) {
+		FATAL_ERROR("Could not open checkpoint index %s", index_path);
+	}
+
+	// the index is only appended to, so the last line for a frame wins
+	bool found = false;
+	char line[4096 + 32];
+	while (fgets(line, sizeof(line), index)) {
+		uint64_t line_frame;
+		int path_start;
+		if (sscanf(line, "%ld %n", &line_frame, &path_start) != 1 || line_frame != frame) {
+			continue;
+		}
+
+		size_t len = strcspn(line + path_start, "\r\n");
+		if (len >= path_size) {
+			FATAL_ERROR("Checkpoint path for frame %ld is too long", frame);
+		}
+
+		memcpy(path, line + path_start, len);
+		path[len] = '\0';
+		found = true;
+	}
+
+	fclose(index);
+	return found;
+}
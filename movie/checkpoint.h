@@ -0,0 +1,23 @@
+#ifndef _CHECKPOINT_H_
+#define _CHECKPOINT_H_
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+// writes savestates out on a worker thread, along with an index of which frame each state is for
+
+struct checkpoint_writer_t;
+typedef struct checkpoint_writer_t checkpoint_writer_t;
+
+// states are written to <prefix>_<frame>.bin, each one gets a "<frame> <path>" line in the index
+checkpoint_writer_t* checkpoint_writer_create(const char* prefix, const char* index_path);
+void checkpoint_writer_destroy(checkpoint_writer_t* writer); // blocks until all pushed states are written
+// takes ownership of state (which must be malloc'd), only blocks if too many states are already pending
+void checkpoint_writer_push(checkpoint_writer_t* writer, uint64_t frame, void* state, uintptr_t length);
+
+// looks frame up in an index written by a checkpoint writer, copying the state's path into path
+// returns false if the index has no state for that frame
+bool checkpoint_find(const char* index_path, uint64_t frame, char* path, size_t path_size);
+
+#endif
@@ -0,0 +1,471 @@
+#define _POSIX_C_SOURCE 200809L
+#include <stdio.h>
+#include <threads.h>
+#include <unistd.h>
+
+#include "alloc.h"
+#include "fatal_error.h"
+#include "file.h"
+#include "min_max.h"
+#include "movie.h"
+
+#define MOVIE_MAGIC "SHMOVIE1"
+#define MOVIE_BUFFER_SIZE (64 * 1024) // for the writer, this is per half of its double buffer
+#define MOVIE_INDEX_INTERVAL 4096 // runs per index entry
+#define MOVIE_MAX_RUN_SIZE (1 + 10) // value + max LEB128 length
+
+typedef struct {
+	uint64_t frame;
+	uint64_t offset;
+} movie_index_entry_t;
+
+typedef struct {
+	uint64_t index_offset;
+	uint64_t num_index_entries;
+	uint64_t num_frames;
+	uint64_t num_runs;
+	char magic[8];
+} movie_footer_t;
+
+struct movie_writer_t {
+	FILE* file;
+	uint8_t* buffers[2];
+	uint8_t* buffer; // front buffer, filled by the emulation thread
+	uint32_t buffer_pos;
+	uint64_t offset; // file offset of buffer[0]
+	uint8_t* back_buffer; // handed off to the worker thread
+	uint32_t back_buffer_len; // 0 once the worker is done with it
+	thrd_t worker;
+	mtx_t lock;
+	cnd_t cond;
+	bool exit;
+	uint8_t run_value;
+	uint64_t run_len;
+	uint64_t num_frames; // not including the pending run
+	uint64_t num_runs;
+	movie_index_entry_t* index;
+	uint64_t num_index_entries;
+};
+
+struct movie_reader_t {
+	FILE* file;
+	uint8_t* buffer;
+	uint32_t buffer_pos;
+	uint32_t buffer_len;
+	movie_index_entry_t* index;
+	uint64_t num_index_entries;
+	uint64_t num_frames;
+	uint64_t runs_end; // file offset where runs end (i.e. the index offset)
+	uint64_t offset; // file offset of buffer[buffer_len]
+	uint8_t run_value;
+	uint64_t run_left;
+	uint64_t frame;
+};
+
+static int movie_writer_worker_thread(void* arg) {
+	movie_writer_t* writer = arg;
+	mtx_lock(&writer->lock);
+
+	while (true) {
+		while (!writer->back_buffer_len && !writer->exit) {
+			cnd_wait(&writer->cond, &writer->lock);
+		}
+
+		if (!writer->back_buffer_len) {
+			break;
+		}
+
+		mtx_unlock(&writer->lock);
+		if (fwrite(writer->back_buffer, 1, writer->back_buffer_len, writer->file) != writer->back_buffer_len) {
+			FATAL_ERROR("Failed to write movie");
+		}
+		mtx_lock(&writer->lock);
+
+		writer->back_buffer_len = 0;
+		cnd_broadcast(&writer->cond);
+	}
+
+	mtx_unlock(&writer->lock);
+	return 0;
+}
+
+static void movie_writer_wait(movie_writer_t* writer) {
+	mtx_lock(&writer->lock);
+	while (writer->back_buffer_len) {
+		cnd_wait(&writer->cond, &writer->lock);
+	}
+	mtx_unlock(&writer->lock);
+}
+
+// hands the front buffer to the worker, only blocking if the worker is still busy with the previous one
+static void movie_writer_flush(movie_writer_t* writer) {
+	if (!writer->buffer_pos) {
+		return;
+	}
+
+	mtx_lock(&writer->lock);
+	while (writer->back_buffer_len) {
+		cnd_wait(&writer->cond, &writer->lock);
+	}
+
+	writer->back_buffer = writer->buffer;
+	writer->back_buffer_len = writer->buffer_pos;
+	cnd_broadcast(&writer->cond);
+	mtx_unlock(&writer->lock);
+
+	writer->buffer = writer->buffer == writer->buffers[0] ? writer->buffers[1] : writer->buffers[0];
+	writer->offset += writer->buffer_pos;
+	writer->buffer_pos = 0;
+}
+
+static void movie_writer_put_run(movie_writer_t* writer) {
+	if (writer->num_runs % MOVIE_INDEX_INTERVAL == 0) {
+		writer->index = ralloc(writer->index, sizeof(movie_index_entry_t) * (writer->num_index_entries + 1));
+		writer->index[writer->num_index_entries].frame = writer->num_frames;
+		writer->index[writer->num_index_entries].offset = writer->offset + writer->buffer_pos;
+		writer->num_index_entries++;
+	}
+
+	if (MOVIE_BUFFER_SIZE - writer->buffer_pos < MOVIE_MAX_RUN_SIZE) {
+		movie_writer_flush(writer);
+	}
+
+	uint8_t* p = &writer->buffer[writer->buffer_pos];
+	*p++ = writer->run_value;
+	uint64_t len = writer->run_len;
+	while (len >= 0x80) {
+		*p++ = (len & 0x7F) | 0x80;
+		len >>= 7;
+	}
+	*p++ = len;
+
+	writer->buffer_pos = p - writer->buffer;
+	writer->num_frames += writer->run_len;
+	writer->num_runs++;
+	writer->run_len = 0;
+}
+
+movie_writer_t* movie_writer_create(const char* path) {
+	movie_writer_t* writer = zalloc(sizeof(movie_writer_t));
+	writer->file = fopen(path, "w+b");
+	if (!writer->file) {
+		FATAL_ERROR("Could not open movie file %s", path);
+	}
+
+	writer->buffers[0] = salloc(MOVIE_BUFFER_SIZE);
+	writer->buffers[1] = salloc(MOVIE_BUFFER_SIZE);
+	writer->buffer = writer->buffers[0];
+	mtx_init(&writer->lock, mtx_plain);
+	cnd_init(&writer->cond);
+	thrd_create(&writer->worker, movie_writer_worker_thread, writer);
+	return writer;
+}
+
+void movie_writer_destroy(movie_writer_t* writer) {
+	if (writer->run_len) {
+		movie_writer_put_run(writer);
+	}
+
+	movie_writer_flush(writer);
+
+	mtx_lock(&writer->lock);
+	writer->exit = true;
+	cnd_broadcast(&writer->cond);
+	mtx_unlock(&writer->lock);
+	thrd_join(writer->worker, NULL);
+	mtx_destroy(&writer->lock);
+	cnd_destroy(&writer->cond);
+
+	movie_footer_t footer;
+	footer.index_offset = writer->offset;
+	footer.num_index_entries = writer->num_index_entries;
+	footer.num_frames = writer->num_frames;
+	footer.num_runs = writer->num_runs;
+	memcpy(footer.magic, MOVIE_MAGIC, sizeof(footer.magic));
+
+	if (fwrite(writer->index, sizeof(movie_index_entry_t), writer->num_index_entries, writer->file) != writer->num_index_entries
+		|| fwrite(&footer, sizeof(movie_footer_t), 1, writer->file) != 1 || fclose(writer->file)) {
+		FATAL_ERROR("Failed to finish movie");
+	}
+
+	free(writer->index);
+	free(writer->buffers[0]);
+	free(writer->buffers[1]);
+	free(writer);
+}
+
+void movie_writer_append(movie_writer_t* writer, uint8_t value, uint64_t count) {
+	if (writer->run_value != value && writer->run_len) {
+		movie_writer_put_run(writer);
+	}
+
+	writer->run_value = value;
+	writer->run_len += count;
+}
+
+uint64_t movie_writer_get_num_frames(movie_writer_t* writer) {
+	return writer->num_frames + writer->run_len;
+}
+
+void movie_writer_sync(movie_writer_t* writer) {
+	if (writer->run_len) {
+		movie_writer_put_run(writer);
+	}
+
+	movie_writer_flush(writer);
+	movie_writer_wait(writer);
+	if (fflush(writer->file) || fsync(fileno(writer->file))) {
+		FATAL_ERROR("Failed to sync movie");
+	}
+}
+
+void movie_writer_truncate(movie_writer_t* writer, uint64_t frame) {
+	if (frame > movie_writer_get_num_frames(writer)) {
+		FATAL_ERROR("Cannot truncate movie to frame %ld, it only has %ld frames", frame, movie_writer_get_num_frames(writer));
+	}
+
+	// only the pending run needs to shrink
+	if (frame >= writer->num_frames) {
+		writer->run_len = frame - writer->num_frames;
+		return;
+	}
+
+	// otherwise, get everything on disk, and find the run with the frame, starting from the closest index entry
+	movie_writer_flush(writer);
+	movie_writer_wait(writer);
+	if (fflush(writer->file)) {
+		FATAL_ERROR("Failed to flush movie");
+	}
+
+	uint64_t entry = writer->num_index_entries - 1;
+	while (writer->index[entry].frame > frame) {
+		entry--;
+	}
+
+	uint64_t offset = writer->index[entry].offset;
+	uint64_t len = writer->offset - offset;
+	uint8_t* runs = salloc(len);
+	if (pread(fileno(writer->file), runs, len, offset) != (ssize_t)len) {
+		FATAL_ERROR("Failed to read back movie");
+	}
+
+	uint64_t run_start = writer->index[entry].frame;
+	uint64_t num_runs = entry * MOVIE_INDEX_INTERVAL;
+	const uint8_t* p = runs;
+	while (true) {
+		const uint8_t* run = p;
+		uint8_t value = *p++;
+		uint64_t run_len = 0;
+		for (uint32_t shift = 0;; shift += 7) {
+			uint8_t b = *p++;
+			run_len |= (uint64_t)(b & 0x7F) << shift;
+			if (!(b & 0x80)) {
+				break;
+			}
+		}
+
+		if (run_start + run_len > frame) {
+			// cut the file before this run, it becomes the pending run
+			offset += run - runs;
+			writer->run_value = value;
+			writer->run_len = frame - run_start;
+			break;
+		}
+
+		run_start += run_len;
+		num_runs++;
+	}
+
+	free(runs);
+
+	if (ftruncate(fileno(writer->file), offset) || fseek(writer->file, offset, SEEK_SET)) {
+		FATAL_ERROR("Failed to truncate movie");
+	}
+
+	writer->offset = offset;
+	writer->num_frames = run_start;
+	writer->num_runs = num_runs;
+	writer->num_index_entries = (num_runs + MOVIE_INDEX_INTERVAL - 1) / MOVIE_INDEX_INTERVAL;
+}
+
+static void movie_reader_fill(movie_reader_t* reader) {
+	uint64_t len = MIN((uint64_t)MOVIE_BUFFER_SIZE, reader->runs_end - reader->offset);
+	if (!len || fread(reader->buffer, 1, len, reader->file) != len) {
+		FATAL_ERROR("Movie is truncated");
+	}
+
+	reader->offset += len;
+	reader->buffer_pos = 0;
+	reader->buffer_len = len;
+}
+
+static inline uint8_t movie_reader_get_byte(movie_reader_t* reader) {
+	if (__builtin_expect(reader->buffer_pos == reader->buffer_len, false)) {
+		movie_reader_fill(reader);
+	}
+
+	return reader->buffer[reader->buffer_pos++];
+}
+
+static void movie_reader_get_run(movie_reader_t* reader) {
+	reader->run_value = movie_reader_get_byte(reader);
+	reader->run_left = 0;
+	for (uint32_t shift = 0;; shift += 7) {
+		uint8_t b = movie_reader_get_byte(reader);
+		reader->run_left |= (uint64_t)(b & 0x7F) << shift;
+		if (!(b & 0x80)) {
+			break;
+		}
+	}
+}
+
+// rebuilds the index for a movie whose writer never finished (i.e. the process died), keeping every complete run
+static void movie_reader_recover(movie_reader_t* reader, const char* path) {
+	uint8_t* data;
+	size_t len = read_entire_file(path, &data);
+	uint64_t num_runs = 0;
+	size_t pos = 0;
+
+	while (pos < len) {
+		size_t run_pos = pos++;
+		uint64_t run_len = 0;
+		bool complete = false;
+		for (uint32_t shift = 0; pos < len && shift < 64; shift += 7) {
+			uint8_t b = data[pos++];
+			run_len |= (uint64_t)(b & 0x7F) << shift;
+			if (!(b & 0x80)) {
+				complete = true;
+				break;
+			}
+		}
+
+		if (!complete || !run_len) {
+			pos = run_pos;
+			break;
+		}
+
+		if (num_runs % MOVIE_INDEX_INTERVAL == 0) {
+			reader->index = ralloc(reader->index, sizeof(movie_index_entry_t) * (reader->num_index_entries + 1));
+			reader->index[reader->num_index_entries].frame = reader->num_frames;
+			reader->index[reader->num_index_entries].offset = run_pos;
+			reader->num_index_entries++;
+		}
+
+		reader->num_frames += run_len;
+		num_runs++;
+	}
+
+	free(data);
+	reader->runs_end = pos;
+	fprintf(stderr, "Recovered %ld frames from unfinished movie %s\n", reader->num_frames, path);
+}
+
+movie_reader_t* movie_reader_create(const char* path) {
+	movie_reader_t* reader = zalloc(sizeof(movie_reader_t));
+	reader->file = fopen(path, "rb");
+	if (!reader->file) {
+		FATAL_ERROR("Could not open movie file %s", path);
+	}
+
+	movie_footer_t footer;
+	if (fseek(reader->file, -(long)sizeof(movie_footer_t), SEEK_END) || fread(&footer, sizeof(movie_footer_t), 1, reader->file) != 1
+		|| memcmp(footer.magic, MOVIE_MAGIC, sizeof(footer.magic))) {
+		movie_reader_recover(reader, path);
+	} else {
+		reader->index = salloc(sizeof(movie_index_entry_t) * MAX(footer.num_index_entries, (uint64_t)1));
+		if (fseek(reader->file, footer.index_offset, SEEK_SET)
+			|| fread(reader->index, sizeof(movie_index_entry_t), footer.num_index_entries, reader->file) != footer.num_index_entries) {
+			FATAL_ERROR("Could not read movie index");
+		}
+
+		reader->num_index_entries = footer.num_index_entries;
+		reader->num_frames = footer.num_frames;
+		reader->runs_end = footer.index_offset;
+	}
+
+	reader->buffer = salloc(MOVIE_BUFFER_SIZE);
+	movie_reader_seek(reader, 0);
+	return reader;
+}
+
+void movie_reader_destroy(movie_reader_t* reader) {
+	fclose(reader->file);
+	free(reader->index);
+	free(reader->buffer);
+	free(reader);
+}
+
+uint64_t movie_reader_get_num_frames(movie_reader_t* reader) {
+	return reader->num_frames;
+}
+
+void movie_reader_seek(movie_reader_t* reader, uint64_t frame) {
+	reader->run_left = 0;
+	reader->buffer_pos = reader->buffer_len = 0;
+	reader->frame = MIN(frame, reader->num_frames);
+	if (reader->frame == reader->num_frames) {
+		return;
+	}
+
+	// find the last index entry at or before the frame
+	uint64_t lo = 0, hi = reader->num_index_entries;
+	while (hi - lo > 1) {
+		uint64_t mid = lo + (hi - lo) / 2;
+		if (reader->index[mid].frame <= frame) {
+			lo = mid;
+		} else {
+			hi = mid;
+		}
+	}
+
+	reader->offset = reader->index[lo].offset;
+	if (fseek(reader->file, reader->offset, SEEK_SET)) {
+		FATAL_ERROR("Failed to seek movie");
+	}
+
+	// then walk the runs after it
+	uint64_t run_start = reader->index[lo].frame;
+	while (true) {
+		movie_reader_get_run(reader);
+		if (run_start + reader->run_left > frame) {
+			reader->run_left -= frame - run_start;
+			break;
+		}
+		run_start += reader->run_left;
+	}
+}
+
+uint64_t movie_reader_next_run(movie_reader_t* reader, uint8_t* value, uint64_t max_frames) {
+	if (!reader->run_left) {
+		if (reader->frame == reader->num_frames) {
+			return 0;
+		}
+		movie_reader_get_run(reader);
+	}
+
+	uint64_t len = MIN(reader->run_left, max_frames);
+	*value = reader->run_value;
+	reader->run_left -= len;
+	reader->frame += len;
+	return len;
+}
+
+void movie_convert_raw(const char* raw_path, const char* path) {
+	FILE* f = fopen(raw_path, "rb");
+	if (!f) {
+		FATAL_ERROR("Could not open raw movie file %s", raw_path);
+	}
+
+	movie_writer_t* writer = movie_writer_create(path);
+	uint8_t* buffer = salloc(MOVIE_BUFFER_SIZE);
+	size_t len;
+	while ((len = fread(buffer, 1, MOVIE_BUFFER_SIZE, f))) {
+		for (size_t i = 0; i < len; i++) {
+			movie_writer_append(writer, buffer[i], 1);
+		}
+	}
+
+	free(buffer);
+	fclose(f);
+	movie_writer_destroy(writer);
+}
@@ -0,0 +1,33 @@
+#ifndef _MOVIE_H_
+#define _MOVIE_H_
+
+#include <stdint.h>
+#include <stdbool.h>
+
+// movies are stored as (pad value, varint run length) pairs, followed by a frame index for seeking
+// writers are double buffered, with a worker thread doing the actual file writes
+
+struct movie_writer_t;
+typedef struct movie_writer_t movie_writer_t;
+
+struct movie_reader_t;
+typedef struct movie_reader_t movie_reader_t;
+
+movie_writer_t* movie_writer_create(const char* path);
+void movie_writer_destroy(movie_writer_t* writer); // finishes the movie, writing out the index
+void movie_writer_append(movie_writer_t* writer, uint8_t value, uint64_t count);
+uint64_t movie_writer_get_num_frames(movie_writer_t* writer);
+void movie_writer_sync(movie_writer_t* writer); // blocks until everything appended is on disk (fsync), an unfinished movie can be read up to its last sync
+void movie_writer_truncate(movie_writer_t* writer, uint64_t frame); // rolls back the movie to the given length
+
+movie_reader_t* movie_reader_create(const char* path);
+void movie_reader_destroy(movie_reader_t* reader);
+uint64_t movie_reader_get_num_frames(movie_reader_t* reader);
+void movie_reader_seek(movie_reader_t* reader, uint64_t frame);
+// reads the rest of the current run (clipped to max_frames) and advances past it, returns 0 at the end of the movie
+uint64_t movie_reader_next_run(movie_reader_t* reader, uint8_t* value, uint64_t max_frames);
+
+// converts a raw movie (one pad byte per frame) to a compact movie
+void movie_convert_raw(const char* raw_path, const char* path);
+
+#endif
@@ -0,0 +1,163 @@
+#define _POSIX_C_SOURCE 200809L
+#include <stdio.h>
+#include <unistd.h>
+
+#include "alloc.h"
+#include "fatal_error.h"
+#include "hash.h"
+#include "sync_log.h"
+
+#define SYNC_LOG_MAGIC "SHSYNC01"
+
+typedef struct {
+	char magic[8];
+	uint32_t interval;
+	uint32_t num_domains;
+} sync_log_header_t; // followed by the size of each domain
+
+typedef struct {
+	uint64_t frame;
+	hash128_t hash;
+} sync_log_entry_t;
+
+struct sync_log_t {
+	FILE* file;
+	bool verify;
+	uint32_t interval;
+	sync_log_domain_t* domains;
+	uint32_t num_domains;
+	uint64_t entries_offset;
+	uint64_t next_frame;
+};
+
+static sync_log_t* sync_log_create(const char* path, bool verify, const sync_log_domain_t* domains, uint32_t num_domains) {
+	sync_log_t* log = zalloc(sizeof(sync_log_t));
+	log->file = fopen(path, verify ? "rb" : "wb");
+	if (!log->file) {
+		FATAL_ERROR("Could not open sync log %s", path);
+	}
+
+	log->verify = verify;
+	log->domains = salloc(sizeof(sync_log_domain_t) * num_domains);
+	memcpy(log->domains, domains, sizeof(sync_log_domain_t) * num_domains);
+	log->num_domains = num_domains;
+	log->entries_offset = sizeof(sync_log_header_t) + sizeof(uint32_t) * num_domains;
+	return log;
+}
+
+sync_log_t* sync_log_create_recorder(const char* path, uint32_t interval, const sync_log_domain_t* domains, uint32_t num_domains) {
+	sync_log_t* log = sync_log_create(path, false, domains, num_domains);
+	log->interval = interval;
+	log->next_frame = interval;
+
+	sync_log_header_t header;
+	memcpy(header.magic, SYNC_LOG_MAGIC, sizeof(header.magic));
+	header.interval = interval;
+	header.num_domains = num_domains;
+	if (fwrite(&header, sizeof(sync_log_header_t), 1, log->file) != 1) {
+		FATAL_ERROR("Failed to write sync log header");
+	}
+
+	for (uint32_t i = 0; i < num_domains; i++) {
+		if (fwrite(&domains[i].size, sizeof(uint32_t), 1, log->file) != 1) {
+			FATAL_ERROR("Failed to write sync log header");
+		}
+	}
+
+	return log;
+}
+
+sync_log_t* sync_log_create_verifier(const char* path, const sync_log_domain_t* domains, uint32_t num_domains) {
+	sync_log_t* log = sync_log_create(path, true, domains, num_domains);
+
+	sync_log_header_t header;
+	if (fread(&header, sizeof(sync_log_header_t), 1, log->file) != 1 || memcmp(header.magic, SYNC_LOG_MAGIC, sizeof(header.magic)) || !header.interval) {
+		FATAL_ERROR("%s is not a valid sync log", path);
+	}
+
+	if (header.num_domains != num_domains) {
+		FATAL_ERROR("Sync log has %d memory domains, but %d were provided", header.num_domains, num_domains);
+	}
+
+	for (uint32_t i = 0; i < num_domains; i++) {
+		uint32_t size;
+		if (fread(&size, sizeof(uint32_t), 1, log->file) != 1 || size != domains[i].size) {
+			FATAL_ERROR("Sync log memory domain %d does not match", i);
+		}
+	}
+
+	log->interval = header.interval;
+	log->next_frame = header.interval;
+	return log;
+}
+
+void sync_log_destroy(sync_log_t* log) {
+	if (fclose(log->file)) {
+		FATAL_ERROR("Failed to close sync log");
+	}
+
+	free(log->domains);
+	free(log);
+}
+
+static hash128_t sync_log_hash(sync_log_t* log) {
+	hash128_t hash = { 0, 0 };
+	for (uint32_t i = 0; i < log->num_domains; i++) {
+		hash = hash_128(log->domains[i].data, log->domains[i].size, hash.lo ^ hash.hi);
+	}
+	return hash;
+}
+
+void sync_log_frame(sync_log_t* log, uint64_t frame) {
+	if (__builtin_expect(frame != log->next_frame, true)) {
+		return;
+	}
+
+	log->next_frame += log->interval;
+
+	sync_log_entry_t entry;
+	if (!log->verify) {
+		entry.frame = frame;
+		entry.hash = sync_log_hash(log);
+		if (fwrite(&entry, sizeof(sync_log_entry_t), 1, log->file) != 1) {
+			FATAL_ERROR("Failed to write sync log");
+		}
+		return;
+	}
+
+	if (fread(&entry, sizeof(sync_log_entry_t), 1, log->file) != 1) {
+		printf("Sync log ended at frame %ld, no longer verifying\n", frame);
+		log->next_frame = UINT64_MAX;
+		return;
+	}
+
+	if (entry.frame != frame) {
+		FATAL_ERROR("Sync log is out of step (expected frame %ld, got frame %ld)", frame, entry.frame);
+	}
+
+	hash128_t hash = sync_log_hash(log);
+	if (!hash_equal(hash, entry.hash)) {
+		FATAL_ERROR("Desync at frame %ld! (expected %016lx%016lx, got %016lx%016lx)", frame, entry.hash.hi, entry.hash.lo, hash.hi, hash.lo);
+	}
+}
+
+void sync_log_seek(sync_log_t* log, uint64_t frame) {
+	uint64_t num_entries = frame / log->interval;
+	uint64_t offset = log->entries_offset + num_entries * sizeof(sync_log_entry_t);
+
+	if (!log->verify) {
+		if (num_entries > log->next_frame / log->interval - 1) {
+			FATAL_ERROR("Cannot seek sync log recorder forwards");
+		}
+
+		if (fflush(log->file) || ftruncate(fileno(log->file), offset)) {
+			FATAL_ERROR("Failed to truncate sync log");
+		}
+	}
+
+	if (fseek(log->file, offset, SEEK_SET)) {
+		FATAL_ERROR("Failed to seek sync log");
+	}
+
+	log->next_frame = (num_entries + 1) * log->interval;
+}
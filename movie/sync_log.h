@@ -0,0 +1,32 @@
+#ifndef _SYNC_LOG_H_
+#define _SYNC_LOG_H_
+
+#include <stdint.h>
+#include <stdbool.h>
+
+// a sync log holds a hash of emulator memory every N frames of a movie
+// recording it while botting and verifying it on playback catches desyncs at the frame they happen
+
+typedef struct {
+	const uint8_t* data;
+	uint32_t size;
+} sync_log_domain_t;
+
+struct sync_log_t;
+typedef struct sync_log_t sync_log_t;
+
+// domains are copied, but not the memory they point to
+// when verifying, the interval is taken from the log, and the domains must match those recorded
+sync_log_t* sync_log_create_recorder(const char* path, uint32_t interval, const sync_log_domain_t* domains, uint32_t num_domains);
+sync_log_t* sync_log_create_verifier(const char* path, const sync_log_domain_t* domains, uint32_t num_domains);
+void sync_log_destroy(sync_log_t* log);
+
+// call after each movie frame, with the number of movie frames emulated so far
+// records or verifies a hash when frame lands on the interval, fatal error on a mismatch
+void sync_log_frame(sync_log_t* log, uint64_t frame);
+
+// recorder: drops hashes after the given frame (for when the movie is rolled back)
+// verifier: skips ahead for playback starting at the given frame
+void sync_log_seek(sync_log_t* log, uint64_t frame);
+
+#endif